@@ -0,0 +1,226 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "aggregates.h"
+
+#include <algorithm>
+#include <math.h>
+
+HyperLogLog::HyperLogLog(int precision) :
+    m_precision(precision),
+    m_registers(1 << precision, 0)
+{
+}
+
+quint64 HyperLogLog::hash(const QByteArray &item) {
+
+    // FNV-1a, then mixed (splitmix64 finalizer) so all bits are usable
+    quint64 hash = Q_UINT64_C(0xcbf29ce484222325);
+    for (int a = 0; a < item.size(); a++) {
+        hash ^= quint8(item.at(a));
+        hash *= Q_UINT64_C(0x100000001b3);
+    }
+    hash ^= hash >> 30;
+    hash *= Q_UINT64_C(0xbf58476d1ce4e5b9);
+    hash ^= hash >> 27;
+    hash *= Q_UINT64_C(0x94d049bb133111eb);
+    hash ^= hash >> 31;
+    return hash;
+}
+
+void HyperLogLog::addHash(quint64 hash) {
+
+    // the first bits select the register, it keeps the
+    // highest position of the first 1 bit in the rest
+    int index = int(hash >> (64 - m_precision));
+    quint64 rest = hash << m_precision;
+    int rank = 1;
+    while (rank <= 64 - m_precision && !(rest & (Q_UINT64_C(1) << 63))) {
+        rank++;
+        rest <<= 1;
+    }
+    if (rank > quint8(m_registers.at(index)))
+        m_registers[index] = char(rank);
+}
+
+double HyperLogLog::estimate() const {
+
+    int registerCount = m_registers.size();
+    double sum = 0;
+    int zeros = 0;
+    for (int a = 0; a < registerCount; a++) {
+        quint8 rank = quint8(m_registers.at(a));
+        sum += ldexp(1.0, -rank);
+        if (rank == 0)
+            zeros++;
+    }
+    double alpha;
+    if (registerCount == 16)
+        alpha = 0.673;
+    else if (registerCount == 32)
+        alpha = 0.697;
+    else if (registerCount == 64)
+        alpha = 0.709;
+    else
+        alpha = 0.7213 / (1 + 1.079 / registerCount);
+    double estimate = alpha * registerCount * registerCount / sum;
+    // for small counts linear counting is more precise
+    if (estimate <= 2.5 * registerCount && zeros > 0)
+        estimate = registerCount * log(double(registerCount) / zeros);
+    return estimate;
+}
+
+SpaceSavingCounter::SpaceSavingCounter(int capacity, int distinctPrecision) :
+    m_capacity(capacity),
+    m_distinctPrecision(distinctPrecision)
+{
+    m_heap.reserve(capacity);
+    m_positions.reserve(capacity);
+}
+
+void SpaceSavingCounter::add(const QString &key, const QByteArray &item) {
+
+    int index;
+    QHash<QString, int>::const_iterator it = m_positions.constFind(key);
+    if (it != m_positions.constEnd()) {
+        index = it.value();
+    } else if (m_heap.count() < m_capacity) {
+        index = m_heap.count();
+        m_heap.append(Entry(m_distinctPrecision));
+        m_heap.last().key = key;
+        m_heap.last().count = 1;
+        m_heap.last().distinct.add(item);
+        m_positions.insert(key, index);
+        siftUp(index);
+        return;
+    } else {
+        // take over the counter with the lowest count
+        index = 0;
+        Entry &entry = m_heap[0];
+        m_positions.remove(entry.key);
+        entry.key = key;
+        entry.error = entry.count;
+        entry.distinct.clear();
+        m_positions.insert(key, 0);
+    }
+    m_heap[index].count++;
+    m_heap[index].distinct.add(item);
+    siftDown(index);
+}
+
+void SpaceSavingCounter::siftUp(int index) {
+
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (m_heap.at(parent).count <= m_heap.at(index).count)
+            return;
+        swapEntries(index, parent);
+        index = parent;
+    }
+}
+
+void SpaceSavingCounter::siftDown(int index) {
+
+    forever {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < m_heap.count() && m_heap.at(left).count < m_heap.at(smallest).count)
+            smallest = left;
+        if (right < m_heap.count() && m_heap.at(right).count < m_heap.at(smallest).count)
+            smallest = right;
+        if (smallest == index)
+            return;
+        swapEntries(index, smallest);
+        index = smallest;
+    }
+}
+
+void SpaceSavingCounter::swapEntries(int a, int b) {
+
+    std::swap(m_heap[a], m_heap[b]);
+    m_positions[m_heap.at(a).key] = a;
+    m_positions[m_heap.at(b).key] = b;
+}
+
+static bool hasHigherCount(const SpaceSavingCounter::Entry &a, const SpaceSavingCounter::Entry &b) {
+
+    return a.count > b.count;
+}
+
+QList<SpaceSavingCounter::Entry> SpaceSavingCounter::top(int n) const {
+
+    QVector<Entry> entries = m_heap;
+    std::sort(entries.begin(), entries.end(), hasHigherCount);
+    return entries.mid(0, n).toList();
+}
+
+CrawlAggregates::CrawlAggregates() :
+    m_results(0),
+    m_sites(14),
+    m_linkingSites(14),
+    m_links(14),
+    // there are only a few hundred CAs and countries; the most linked
+    // sites get a small sketch each, it is only about the top ones
+    m_rootOrganizations(256, 10),
+    m_siteCountries(256, 10),
+    m_linkedSites(1024, 6)
+{
+}
+
+void CrawlAggregates::addResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                                const QString &rootOrganization, const QString &siteCountry) {
+
+    // a site is a host here, the same certificate is found at many URLs of it
+    QString site = urlWithCertificate.host();
+    QByteArray siteItem = site.toUtf8();
+    QByteArray linkingSiteItem = originalUrl.toEncoded();
+    m_results++;
+    m_sites.add(siteItem);
+    m_linkingSites.add(linkingSiteItem);
+    m_links.add(linkingSiteItem + ' ' + siteItem);
+    m_rootOrganizations.add(rootOrganization, siteItem);
+    m_siteCountries.add(siteCountry, siteItem);
+    m_linkedSites.add(site, linkingSiteItem);
+}
+
+static void appendTable(QByteArray *text, const char *title, const QList<SpaceSavingCounter::Entry> &entries) {
+
+    // the results count can be too high by up to the overcount,
+    // the distinct counts are estimates
+    *text += QByteArray("# ") + title + ";distinct;results;results overcount\n";
+    foreach (const SpaceSavingCounter::Entry &entry, entries) {
+        *text += entry.key.toUtf8() + ';' + QByteArray::number(qRound64(entry.distinct.estimate())) + ';'
+                + QByteArray::number(entry.count) + ';' + QByteArray::number(entry.error) + '\n';
+    }
+}
+
+QByteArray CrawlAggregates::summary(int topCount) const {
+
+    QByteArray text = "# results;https sites;linking sites;links (distinct counts are estimates)\n"
+            + QByteArray::number(m_results) + ';' + QByteArray::number(qRound64(m_sites.estimate())) + ';'
+            + QByteArray::number(qRound64(m_linkingSites.estimate())) + ';'
+            + QByteArray::number(qRound64(m_links.estimate())) + '\n';
+    appendTable(&text, "root certificate organization (distinct: sites)", m_rootOrganizations.top(topCount));
+    appendTable(&text, "site certificate country (distinct: sites)", m_siteCountries.top(topCount));
+    appendTable(&text, "linked site (distinct: linking sites)", m_linkedSites.top(topCount));
+    return text;
+}
@@ -0,0 +1,108 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef AGGREGATES_H
+#define AGGREGATES_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QUrl>
+#include <QVector>
+
+// estimates the number of distinct items added in 2^precision bytes,
+// with a standard error of about 1.04 / sqrt(2^precision) (Flajolet et al.)
+class HyperLogLog
+{
+public:
+    explicit HyperLogLog(int precision = 12);
+
+    void add(const QByteArray &item) { addHash(hash(item)); }
+    void addHash(quint64 hash);
+    double estimate() const;
+    void clear() { m_registers.fill(0); }
+
+    static quint64 hash(const QByteArray &item);
+
+private:
+    int m_precision;
+    QByteArray m_registers;
+};
+
+// the most frequent keys of a stream in fixed memory ("space saving",
+// Metwally et al.): there are only capacity counters, a new key takes over
+// the one with the lowest count. Its count is then too high by at most
+// that count, which is kept as the error.
+// Every counter also estimates how many distinct items came with its key.
+class SpaceSavingCounter
+{
+public:
+    class Entry {
+    public:
+        explicit Entry(int precision = 4) : count(0), error(0), distinct(precision) { }
+        QString key;
+        qint64 count;
+        qint64 error;
+        HyperLogLog distinct;
+    };
+
+    SpaceSavingCounter(int capacity, int distinctPrecision);
+
+    void add(const QString &key, const QByteArray &item);
+    // at most n entries, highest count first
+    QList<Entry> top(int n) const;
+
+private:
+    void siftUp(int index);
+    void siftDown(int index);
+    void swapEntries(int a, int b);
+
+    int m_capacity;
+    int m_distinctPrecision;
+    QVector<Entry> m_heap; // min-heap by count
+    QHash<QString, int> m_positions; // key -> index into m_heap
+};
+
+// the numbers we want from a crawl, updated with every result.
+// Memory does not depend on the size of the crawl.
+class CrawlAggregates
+{
+public:
+    CrawlAggregates();
+
+    void addResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                   const QString &rootOrganization, const QString &siteCountry);
+    qint64 resultCount() const { return m_results; }
+    // the topCount entries of every table, as text
+    QByteArray summary(int topCount) const;
+
+private:
+    qint64 m_results;
+    HyperLogLog m_sites;
+    HyperLogLog m_linkingSites;
+    HyperLogLog m_links;
+    SpaceSavingCounter m_rootOrganizations;
+    SpaceSavingCounter m_siteCountries;
+    SpaceSavingCounter m_linkedSites;
+};
+
+#endif // AGGREGATES_H
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Benchmark of the crawler against a local fake server farm,
+# build with "make benchmark" in the top level build directory
+#
+#-------------------------------------------------
+
+QT       += core network
+
+QT       -= gui
+
+TARGET = qt-ssl-crawl-bench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include(../crawler.pri)
+
+DEFINES += BENCH_SOURCE_DIR=\\\"$$PWD\\\"
+
+SOURCES += main.cpp \
+    fakeserverfarm.cpp \
+    crawlbenchmark.cpp
+
+HEADERS += \
+    fakeserverfarm.h \
+    crawlbenchmark.h
+
+OTHER_FILES += \
+    generate-certificates.sh
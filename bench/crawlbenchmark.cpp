@@ -0,0 +1,197 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "crawlbenchmark.h"
+#include "qt-ssl-crawler.h"
+#include "resultparser.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkProxy>
+#include <QProcess>
+#include <QTextStream>
+#include <QDebug>
+
+#include <algorithm>
+#include <sys/resource.h>
+
+CrawlBenchmark::CrawlBenchmark(const FakeServerFarm::Config &config, const QStringList &serverArguments,
+                               QObject *parent) :
+    QObject(parent),
+    m_config(config),
+    m_serverArguments(serverArguments),
+    m_probeMode(false),
+    m_timeout(5000),
+    m_server(0),
+    m_crawler(0),
+    m_parser(0),
+    m_resultCount(0)
+{
+}
+
+CrawlBenchmark::~CrawlBenchmark() {
+
+    delete m_parser;
+    delete m_crawler;
+    if (m_server) {
+        m_server->kill();
+        m_server->waitForFinished();
+    }
+}
+
+bool CrawlBenchmark::prepareCertificates() {
+
+    if (QFile::exists(m_certificateDirectory + QStringLiteral("/root.pem")))
+        return true;
+    qWarning() << "generating certificates in" << m_certificateDirectory;
+    QString script = QStringLiteral(BENCH_SOURCE_DIR "/generate-certificates.sh");
+    return QProcess::execute(QStringLiteral("sh"), QStringList() << script << m_certificateDirectory) == 0;
+}
+
+void CrawlBenchmark::writeDomainFile() {
+
+    // the crawler reads top-1m.csv from the current directory
+    QFile file(m_workingDirectory.path() + QStringLiteral("/top-1m.csv"));
+    if (!file.open(QIODevice::WriteOnly))
+        qFatal("could not write %s", qPrintable(file.fileName()));
+    QTextStream stream(&file);
+    for (int a = 1; a <= m_config.siteCount; a++)
+        stream << a << ",site" << a << ".bench\n";
+}
+
+void CrawlBenchmark::start() {
+
+    m_certificateDirectory = QFileInfo(m_certificateDirectory).absoluteFilePath();
+    if (!prepareCertificates())
+        qFatal("could not generate the certificates");
+    writeDomainFile();
+    QDir::setCurrent(m_workingDirectory.path());
+
+    m_server = new QProcess(this);
+    m_server->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    // our --certificates comes last, the server runs in the working directory, too
+    m_server->start(QCoreApplication::applicationFilePath(), QStringList() << m_serverArguments
+                    << QStringLiteral("--serve") << QStringLiteral("--certificates") << m_certificateDirectory);
+    // the first line is the port the server listens on
+    if (!m_server->waitForStarted() || !m_server->waitForReadyRead(30000))
+        qFatal("could not start the fake server farm");
+    int port = m_server->readLine().trimmed().toInt();
+    connect(m_server, SIGNAL(readyReadStandardOutput()), this, SLOT(readServerOutput()));
+    QNetworkProxy::setApplicationProxy(QNetworkProxy(QNetworkProxy::HttpProxy, QStringLiteral("127.0.0.1"), port));
+
+    m_crawler = new QtSslCrawler(0, 1, m_config.siteCount);
+    m_crawler->setHostResolution(0, 0); // the proxy resolves (or not)
+    m_crawler->setTimeouts(m_timeout, m_timeout, 6 * m_timeout);
+    m_crawler->setProbeMode(m_probeMode);
+    connect(m_crawler, SIGNAL(crawlResult(QUrl,QUrl,QList<QSslCertificate>)),
+            this, SLOT(result(QUrl,QUrl,QList<QSslCertificate>)));
+    m_parser = new ResultParser(m_crawler, m_workingDirectory.path() + QStringLiteral("/results.csv"),
+                                ResultWriter::CsvFormat, ResultParser::CollectMode);
+    connect(m_parser, SIGNAL(parsingDone()), this, SLOT(report()));
+    qWarning() << "crawling" << m_config.siteCount << "sites through the fake server farm on port" << port;
+    m_clock.start();
+    m_crawler->start();
+}
+
+void CrawlBenchmark::readServerOutput() {
+
+    while (m_server->canReadLine()) {
+        QList<QByteArray> fields = m_server->readLine().trimmed().split(' ');
+        if (fields.count() == 3 && fields.at(0) == "contact")
+            m_firstContacts.insert(QString::fromLatin1(fields.at(1)), fields.at(2).toLongLong());
+        else if (fields.count() == 2 && fields.at(0) == "unknown")
+            m_unknownHostRequests[QString::fromLatin1(fields.at(1))]++;
+    }
+}
+
+void CrawlBenchmark::result(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                            const QList<QSslCertificate> &certificateChain) {
+
+    Q_UNUSED(originalUrl);
+    Q_UNUSED(certificateChain);
+    m_resultCount++;
+    // see FakeServerFarm: www.site1.bench and secure.site1.bench are site1.bench
+    QString host = urlWithCertificate.host();
+    QString site = host.mid(host.indexOf(QLatin1Char('.')) + 1);
+    if (!m_firstResults.contains(site))
+        m_firstResults.insert(site, QElapsedTimer::msecsSinceReference());
+}
+
+void CrawlBenchmark::report() {
+
+    qint64 elapsed = m_clock.elapsed();
+    m_server->waitForReadyRead(1000); // the last contacts
+    readServerOutput();
+
+    QList<qint64> latencies;
+    QHash<QString, qint64>::const_iterator it = m_firstResults.constBegin();
+    for (; it != m_firstResults.constEnd(); ++it) {
+        if (m_firstContacts.contains(it.key()))
+            latencies.append(it.value() - m_firstContacts.value(it.key()));
+    }
+    std::sort(latencies.begin(), latencies.end());
+    qint64 p50 = latencies.isEmpty() ? 0 : latencies.at(latencies.count() / 2);
+    qint64 p99 = latencies.isEmpty() ? 0 : latencies.at(qMin(latencies.count() - 1, latencies.count() * 99 / 100));
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6
+            + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    QByteArray peakRss = "?";
+    QFile status(QStringLiteral("/proc/self/status"));
+    if (status.open(QIODevice::ReadOnly)) {
+        foreach (const QByteArray &line, status.readAll().split('\n')) {
+            if (line.startsWith("VmHWM:"))
+                peakRss = line.mid(6).simplified();
+        }
+    }
+
+    // a host which does not exist must cost one attempt: no retry, no http://
+    int unknownRequests = 0;
+    int repeatedUnknownHosts = 0;
+    foreach (int requests, m_unknownHostRequests) {
+        unknownRequests += requests;
+        if (requests > 1)
+            repeatedUnknownHosts++;
+    }
+
+    int sites = m_firstResults.count();
+    QTextStream out(stdout);
+    out << "sites with certificate: " << sites << " (" << m_resultCount << " results, "
+        << m_firstContacts.count() << " sites contacted)\n"
+        << "time:                   " << elapsed / 1000.0 << " s\n"
+        << "sites/s:                " << (elapsed ? sites * 1000.0 / elapsed : 0) << "\n"
+        << "latency per site:       p50 " << p50 << " ms, p99 " << p99 << " ms\n"
+        << "peak RSS:               " << peakRss << "\n"
+        << "CPU per site:           " << (sites ? cpuSeconds * 1000 / sites : 0) << " ms ("
+        << cpuSeconds << " s in total)\n"
+        << "unknown hosts:          " << m_unknownHostRequests.count() << " (" << unknownRequests
+        << " requests)\n";
+    out.flush();
+    if (repeatedUnknownHosts > 0) {
+        qWarning() << repeatedUnknownHosts << "unknown hosts were requested more than once";
+        QCoreApplication::exit(1);
+        return;
+    }
+    QCoreApplication::quit();
+}
@@ -0,0 +1,86 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CRAWLBENCHMARK_H
+#define CRAWLBENCHMARK_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QSslCertificate>
+
+#include "fakeserverfarm.h"
+
+class QProcess;
+class QtSslCrawler;
+class ResultParser;
+
+// crawls the fake server farm (running in a child process, so it does
+// not count for our CPU time and memory) with QtSslCrawler and
+// ResultParser and reports throughput, per site latency, peak RSS and
+// CPU time per site
+class CrawlBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    CrawlBenchmark(const FakeServerFarm::Config &config, const QStringList &serverArguments,
+                   QObject *parent = 0);
+    ~CrawlBenchmark();
+
+    void setCertificateDirectory(const QString &directory) { m_certificateDirectory = directory; }
+    void setProbeMode(bool probeMode) { m_probeMode = probeMode; }
+    // in msecs, see QtSslCrawler::setTimeouts()
+    void setTimeout(int timeout) { m_timeout = timeout; }
+
+public slots:
+    void start();
+
+private slots:
+    void readServerOutput();
+    void result(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                const QList<QSslCertificate> &certificateChain);
+    void report();
+
+private:
+    bool prepareCertificates();
+    void writeDomainFile();
+
+    FakeServerFarm::Config m_config;
+    QStringList m_serverArguments;
+    QString m_certificateDirectory;
+    bool m_probeMode;
+    int m_timeout;
+    QTemporaryDir m_workingDirectory;
+    QProcess *m_server;
+    QtSslCrawler *m_crawler;
+    ResultParser *m_parser;
+    QElapsedTimer m_clock;
+    int m_resultCount;
+    // by site, see FakeServerFarm::logContact()
+    QHash<QString, qint64> m_firstContacts;
+    QHash<QString, qint64> m_firstResults;
+    // by host, every request the farm got for an unknown host
+    QHash<QString, int> m_unknownHostRequests;
+};
+
+#endif // CRAWLBENCHMARK_H
@@ -0,0 +1,256 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "fakeserverfarm.h"
+
+#include <QSslSocket>
+#include <QSslConfiguration>
+#include <QFile>
+#include <QTimer>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QUrl>
+#include <QDebug>
+
+FakeServerFarm::Config::Config() :
+    siteCount(1000),
+    handshakeLatency(50),
+    linksPerPage(20),
+    redirectHops(2),
+    redirectRatio(0.2),
+    stallRatio(0.02),
+    unknownRatio(0.05),
+    deepLinkRatio(0)
+{
+}
+
+// "www.site12.bench" and "secure.site12.bench" belong to the site "site12.bench"
+static QString siteForHost(const QString &host)
+{
+    int dot = host.indexOf(QLatin1Char('.'));
+    if (host.count(QLatin1Char('.')) > 1 && dot > 0)
+        return host.mid(dot + 1);
+    return host;
+}
+
+FakeServerFarm::FakeServerFarm(const Config &config, QObject *parent) :
+    QTcpServer(parent),
+    m_config(config),
+    m_contactLog(0)
+{
+}
+
+bool FakeServerFarm::loadCertificates(const QString &directory) {
+
+    QList<QSslCertificate> roots = QSslCertificate::fromPath(directory + QStringLiteral("/root.pem"));
+    if (roots.isEmpty())
+        return false;
+    for (int a = 0; ; a++) {
+        QString index = QString::number(a);
+        QList<QSslCertificate> leaf = QSslCertificate::fromPath(directory + QStringLiteral("/leaf") + index + QStringLiteral(".pem"));
+        QList<QSslCertificate> intermediate = QSslCertificate::fromPath(directory + QStringLiteral("/intermediate") + index + QStringLiteral(".pem"));
+        QFile keyFile(directory + QStringLiteral("/leaf") + index + QStringLiteral(".key"));
+        if (leaf.isEmpty() || intermediate.isEmpty() || !keyFile.open(QIODevice::ReadOnly))
+            break;
+        QSslKey key(&keyFile, QSsl::Rsa);
+        if (key.isNull())
+            return false;
+        m_chains.append(QList<QSslCertificate>() << leaf.first() << intermediate.first() << roots.first());
+        m_keys.append(key);
+    }
+    return !m_chains.isEmpty();
+}
+
+FakeServerFarm::HostBehavior FakeServerFarm::behavior(const QString &host) const {
+
+    if (!host.endsWith(QLatin1String(".bench")))
+        return UnknownHost;
+    if (host.startsWith(QLatin1String("secure.")))
+        return NormalHost; // where the redirecting hosts point to
+    double share = (qHash(siteForHost(host), 0) % 10000) / 10000.0;
+    if (share < m_config.unknownRatio)
+        return UnknownHost;
+    share -= m_config.unknownRatio;
+    if (share < m_config.stallRatio)
+        return StallingHost;
+    share -= m_config.stallRatio;
+    if (share < m_config.redirectRatio)
+        return RedirectingHost;
+    return NormalHost;
+}
+
+int FakeServerFarm::chainIndex(const QString &host) const {
+
+    return qHash(siteForHost(host), 1) % m_chains.count();
+}
+
+void FakeServerFarm::incomingConnection(qintptr socketDescriptor) {
+
+    QSslSocket *socket = new QSslSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        delete socket;
+        return;
+    }
+    m_connections.insert(socket, Connection());
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(connectionClosed()));
+}
+
+void FakeServerFarm::readRequest() {
+
+    QSslSocket *socket = qobject_cast<QSslSocket *>(sender());
+    Connection &connection = m_connections[socket];
+    if (connection.tunnel && !socket->isEncrypted())
+        return; // the ClientHello, it is read by the handshake once that starts
+    connection.buffer.append(socket->readAll());
+    int headerEnd = connection.buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0)
+        return;
+    QByteArray header = connection.buffer.left(headerEnd);
+    connection.buffer.clear(); // the crawler only sends GET, no bodies
+    if (connection.tunnel) {
+        QList<QByteArray> requestLine = header.left(header.indexOf("\r\n")).split(' ');
+        handleRequest(socket, connection.host, requestLine.value(1), true);
+    } else {
+        handleProxyRequest(socket, connection, header);
+    }
+}
+
+void FakeServerFarm::handleProxyRequest(QSslSocket *socket, Connection &connection, const QByteArray &header) {
+
+    QList<QByteArray> requestLine = header.left(header.indexOf("\r\n")).split(' ');
+    QByteArray method = requestLine.value(0);
+    QByteArray target = requestLine.value(1);
+    QString host;
+    if (method == "CONNECT")
+        host = QString::fromLatin1(target.left(target.indexOf(':'))).toLower();
+    else
+        host = QUrl::fromEncoded(target).host();
+    logContact(host);
+
+    HostBehavior hostBehavior = behavior(host);
+    if (hostBehavior == UnknownHost) {
+        // Qt reports a 404 to CONNECT as HostNotFoundError, so the crawler
+        // sees a failed DNS lookup; a plain request gets a 404 as well
+        logUnknownHostRequest(host);
+        writeResponse(socket, "404 Not Found", QByteArray(), QByteArray());
+        return;
+    }
+    if (method == "CONNECT" && hostBehavior == RedirectingHost) {
+        writeResponse(socket, "502 Bad Gateway", QByteArray(), QByteArray());
+        return;
+    }
+    if (method == "CONNECT") {
+        connection.host = host;
+        connection.tunnel = true;
+        socket->write("HTTP/1.1 200 Connection established\r\n\r\n");
+        if (hostBehavior == StallingHost)
+            return; // the client waits for the handshake forever
+        QSslConfiguration configuration = socket->sslConfiguration();
+        int index = chainIndex(host);
+        configuration.setLocalCertificateChain(m_chains.at(index));
+        configuration.setPrivateKey(m_keys.at(index));
+        socket->setSslConfiguration(configuration);
+        // simulates the round trips and the work of a real handshake
+        QTimer *timer = new QTimer(socket);
+        timer->setSingleShot(true);
+        connect(timer, SIGNAL(timeout()), this, SLOT(startHandshake()));
+        timer->start(m_config.handshakeLatency);
+    } else {
+        handleRequest(socket, host, QUrl::fromEncoded(target).path(QUrl::FullyEncoded).toLatin1(), false);
+    }
+}
+
+void FakeServerFarm::startHandshake() {
+
+    QSslSocket *socket = qobject_cast<QSslSocket *>(sender()->parent());
+    sender()->deleteLater();
+    socket->startServerEncryption();
+}
+
+void FakeServerFarm::handleRequest(QSslSocket *socket, const QString &host, const QByteArray &path, bool https) {
+
+    if (behavior(host) == RedirectingHost && !https) {
+        // /, /hop1, /hop2, ... and finally the https site
+        int hop = path.startsWith("/hop") ? path.mid(4).toInt() : 0;
+        QByteArray location;
+        if (hop + 1 < m_config.redirectHops)
+            location = "http://" + host.toLatin1() + "/hop" + QByteArray::number(hop + 1);
+        else
+            location = "https://secure." + siteForHost(host).toLatin1() + "/";
+        writeResponse(socket, "301 Moved Permanently", "Location: " + location + "\r\n", QByteArray());
+        return;
+    }
+    writeResponse(socket, "200 OK", "Content-Type: text/html\r\n", page(host));
+}
+
+QByteArray FakeServerFarm::page(const QString &host) const {
+
+    QByteArray body = "<html><head><title>" + host.toLatin1() + "</title></head><body>\n";
+    quint32 random = qHash(host, 2);
+    for (int a = 0; a < m_config.linksPerPage; a++) {
+        random = random * 1664525u + 1013904223u;
+        int site = (random >> 8) % (2 * m_config.siteCount) + 1;
+        QByteArray path = "/";
+        if (m_config.deepLinkRatio > 0) { // keeps the links of the default farm
+            random = random * 1664525u + 1013904223u;
+            if ((random >> 8) % 1000 < quint32(m_config.deepLinkRatio * 1000))
+                path += "page" + QByteArray::number(a);
+        }
+        body += "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+                "incididunt ut labore et dolore magna aliqua. <a href=\"https://www.site"
+                + QByteArray::number(site) + ".bench" + path + "\">site " + QByteArray::number(site) + "</a></p>\n";
+    }
+    body += "</body></html>\n";
+    return body;
+}
+
+void FakeServerFarm::writeResponse(QSslSocket *socket, const QByteArray &status,
+                                   const QByteArray &extraHeaders, const QByteArray &body) {
+
+    socket->write("HTTP/1.1 " + status + "\r\n" + extraHeaders
+                  + "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                  + "Connection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
+}
+
+void FakeServerFarm::connectionClosed() {
+
+    QSslSocket *socket = qobject_cast<QSslSocket *>(sender());
+    m_connections.remove(socket);
+    socket->deleteLater();
+}
+
+void FakeServerFarm::logUnknownHostRequest(const QString &host) {
+
+    if (m_contactLog)
+        *m_contactLog << "unknown " << host << endl;
+}
+
+void FakeServerFarm::logContact(const QString &host) {
+
+    QString site = siteForHost(host);
+    if (!m_contactLog || m_contactedHosts.contains(site))
+        return;
+    m_contactedHosts.insert(site);
+    // monotonic, so the benchmark process can compare it to its own clock
+    *m_contactLog << "contact " << site << ' ' << QElapsedTimer::msecsSinceReference() << endl;
+}
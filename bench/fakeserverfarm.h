@@ -0,0 +1,107 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef FAKESERVERFARM_H
+#define FAKESERVERFARM_H
+
+#include <QTcpServer>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QSslCertificate>
+#include <QSslKey>
+
+class QSslSocket;
+class QTextStream;
+
+// a stand-in for the internet: an HTTP proxy on loopback which serves
+// every host *.bench itself. CONNECT requests are answered by doing the
+// TLS handshake with one of the generated certificate chains, plain
+// requests are answered directly. What a host does is derived from its
+// name, so every run of the benchmark sees the same "internet".
+class FakeServerFarm : public QTcpServer
+{
+    Q_OBJECT
+public:
+    enum HostBehavior {
+        NormalHost,      // https works, the page links to other hosts
+        RedirectingHost, // only http, redirects a few times to https://secure.<domain>
+        StallingHost,    // accepts the connection, but never does the handshake
+        UnknownHost      // like a DNS failure, the proxy answers with 404
+    };
+
+    class Config {
+    public:
+        Config();
+        int siteCount;          // sites in top-1m.csv, links point to twice as many
+        int handshakeLatency;   // msecs before the handshake starts
+        int linksPerPage;
+        int redirectHops;
+        double redirectRatio;   // shares of the hosts behaving like this
+        double stallRatio;
+        double unknownRatio;
+        double deepLinkRatio;   // share of the links to a page below the root of a site
+    };
+
+    explicit FakeServerFarm(const Config &config, QObject *parent = 0);
+
+    // reads root.pem, intermediate<n>.pem, leaf<n>.pem and leaf<n>.key
+    bool loadCertificates(const QString &directory);
+    HostBehavior behavior(const QString &host) const;
+    // the first contact of every host and every request for an unknown
+    // host are written here, see CrawlBenchmark
+    void setContactLog(QTextStream *log) { m_contactLog = log; }
+
+protected:
+    void incomingConnection(qintptr socketDescriptor);
+
+private slots:
+    void readRequest();
+    void startHandshake();
+    void connectionClosed();
+
+private:
+    class Connection {
+    public:
+        Connection() : tunnel(false) { }
+        QByteArray buffer;
+        QString host;
+        bool tunnel; // CONNECT was answered, https from now on
+    };
+
+    void handleProxyRequest(QSslSocket *socket, Connection &connection, const QByteArray &header);
+    void handleRequest(QSslSocket *socket, const QString &host, const QByteArray &path, bool https);
+    void writeResponse(QSslSocket *socket, const QByteArray &status,
+                       const QByteArray &extraHeaders, const QByteArray &body);
+    QByteArray page(const QString &host) const;
+    int chainIndex(const QString &host) const;
+    void logContact(const QString &host);
+    void logUnknownHostRequest(const QString &host);
+
+    Config m_config;
+    QList<QList<QSslCertificate> > m_chains;
+    QList<QSslKey> m_keys;
+    QHash<QSslSocket *, Connection> m_connections;
+    QSet<QString> m_contactedHosts;
+    QTextStream *m_contactLog;
+};
+
+#endif // FAKESERVERFARM_H
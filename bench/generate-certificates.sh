@@ -0,0 +1,41 @@
+#!/bin/sh
+#
+# generates the certificates for the fake server farm of the benchmark:
+# one root CA, <groups> intermediate CAs (with different organizations
+# and countries) and one *.bench leaf certificate per intermediate.
+# Every benchmark host serves the chain of one group.
+#
+# usage: generate-certificates.sh <directory> [groups]
+
+set -e
+
+dir=${1:-certificates}
+groups=${2:-16}
+countries="US DE GB FR JP NL SE CH CA AU"
+
+mkdir -p "$dir"
+cd "$dir"
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 3650 -keyout root.key -out root.pem \
+    -subj "/C=US/O=Bench Root Authority/CN=Bench Root CA" 2>/dev/null
+printf 'basicConstraints=critical,CA:TRUE\nkeyUsage=critical,keyCertSign,cRLSign\n' > ca.ext
+printf 'basicConstraints=CA:FALSE\nsubjectAltName=DNS:*.bench\n' > leaf.ext
+
+i=0
+while [ $i -lt $groups ]; do
+    set -- $countries
+    shift $((i % $#))
+    country=$1
+    openssl req -newkey rsa:2048 -nodes -keyout intermediate$i.key -out intermediate$i.csr \
+        -subj "/C=$country/O=Bench CA $i/CN=Bench Intermediate CA $i" 2>/dev/null
+    openssl x509 -req -days 3650 -in intermediate$i.csr -CA root.pem -CAkey root.key \
+        -set_serial $((1000 + i)) -extfile ca.ext -out intermediate$i.pem 2>/dev/null
+    openssl req -newkey rsa:2048 -nodes -keyout leaf$i.key -out leaf$i.csr \
+        -subj "/C=$country/O=Bench Sites $i/CN=*.bench" 2>/dev/null
+    openssl x509 -req -days 825 -in leaf$i.csr -CA intermediate$i.pem -CAkey intermediate$i.key \
+        -set_serial $((2000 + i)) -extfile leaf.ext -out leaf$i.pem 2>/dev/null
+    i=$((i + 1))
+done
+
+rm -f ./*.csr ./*.ext
+echo "generated $groups certificate chains in $dir"
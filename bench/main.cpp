@@ -0,0 +1,160 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include <QtCore/QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QRegExp>
+#include <QTextStream>
+#include <QHostAddress>
+
+#include "crawlbenchmark.h"
+#include "fakeserverfarm.h"
+#include "urlextractor.h"
+
+// compares UrlExtractor to the regexp the crawler used before,
+// on a link heavy body of the given size
+static void benchmarkExtractor(int bodySize)
+{
+    QByteArray body;
+    int links = 0;
+    while (body.size() < bodySize) {
+        body += "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+                "incididunt ut labore et dolore magna aliqua. <a href=\"https://www.site"
+                + QByteArray::number(links) + ".example.com/path\">link</a></p>\n";
+        links++;
+    }
+    QTextStream out(stdout);
+
+    QElapsedTimer timer;
+    timer.start();
+    UrlExtractor extractor;
+    for (int offset = 0; offset < body.size(); offset += 16384)
+        extractor.feed(body.mid(offset, 16384)); // chunks as they come from the network
+    extractor.finish();
+    int found = extractor.takeUrls().count();
+    qint64 extractorTime = qMax<qint64>(1, timer.nsecsElapsed() / 1000);
+
+    timer.restart();
+    QString text = QString::fromLatin1(body); // once, the old code converted for every match
+    QRegExp regExp(QStringLiteral("(https://[a-z0-9.@:]+)"), Qt::CaseInsensitive);
+    int regExpFound = 0;
+    int pos = 0;
+    while ((pos = regExp.indexIn(text, pos)) != -1) {
+        regExpFound++;
+        pos += regExp.matchedLength();
+    }
+    qint64 regExpTime = qMax<qint64>(1, timer.nsecsElapsed() / 1000);
+
+    out << "body: " << body.size() << " bytes, " << links << " links\n"
+        << "UrlExtractor: " << found << " URLs in " << extractorTime << " us ("
+        << body.size() / double(extractorTime) << " MB/s)\n"
+        << "QRegExp:      " << regExpFound << " URLs in " << regExpTime << " us ("
+        << body.size() / double(regExpTime) << " MB/s)\n";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser commandLineParser;
+    commandLineParser.setApplicationDescription(QStringLiteral("Benchmarks qt-ssl-crawl against a local fake server farm"));
+    commandLineParser.addHelpOption();
+    QCommandLineOption sitesOption(QStringLiteral("sites"),
+            QStringLiteral("Number of sites in the generated top-1m.csv."), QStringLiteral("n"), QStringLiteral("1000"));
+    commandLineParser.addOption(sitesOption);
+    QCommandLineOption latencyOption(QStringLiteral("handshake-latency"),
+            QStringLiteral("Delay of the fake servers before the TLS handshake."), QStringLiteral("msecs"), QStringLiteral("50"));
+    commandLineParser.addOption(latencyOption);
+    QCommandLineOption linksOption(QStringLiteral("links"),
+            QStringLiteral("Links to other sites per page."), QStringLiteral("n"), QStringLiteral("20"));
+    commandLineParser.addOption(linksOption);
+    QCommandLineOption hopsOption(QStringLiteral("redirect-hops"),
+            QStringLiteral("Length of the redirect chains."), QStringLiteral("n"), QStringLiteral("2"));
+    commandLineParser.addOption(hopsOption);
+    QCommandLineOption redirectOption(QStringLiteral("redirect-ratio"),
+            QStringLiteral("Share of the sites only reachable by http, redirecting to https."),
+            QStringLiteral("ratio"), QStringLiteral("0.2"));
+    commandLineParser.addOption(redirectOption);
+    QCommandLineOption stallOption(QStringLiteral("stall-ratio"),
+            QStringLiteral("Share of the sites never finishing the handshake."), QStringLiteral("ratio"), QStringLiteral("0.02"));
+    commandLineParser.addOption(stallOption);
+    QCommandLineOption unknownOption(QStringLiteral("unknown-ratio"),
+            QStringLiteral("Share of the sites which do not resolve."), QStringLiteral("ratio"), QStringLiteral("0.05"));
+    commandLineParser.addOption(unknownOption);
+    QCommandLineOption deepLinkOption(QStringLiteral("deep-link-ratio"),
+            QStringLiteral("Share of the links to a page below the root of a site."), QStringLiteral("ratio"), QStringLiteral("0"));
+    commandLineParser.addOption(deepLinkOption);
+    QCommandLineOption timeoutOption(QStringLiteral("timeout"),
+            QStringLiteral("Connect and handshake timeout of the crawler."), QStringLiteral("msecs"), QStringLiteral("5000"));
+    commandLineParser.addOption(timeoutOption);
+    QCommandLineOption probeOption(QStringLiteral("probe"), QStringLiteral("Crawl in probe mode."));
+    commandLineParser.addOption(probeOption);
+    QCommandLineOption certificatesOption(QStringLiteral("certificates"),
+            QStringLiteral("Directory of the certificates, generated if missing."),
+            QStringLiteral("directory"), QStringLiteral("bench-certificates"));
+    commandLineParser.addOption(certificatesOption);
+    QCommandLineOption extractorOption(QStringLiteral("extractor"),
+            QStringLiteral("Compare the URL extractor to QRegExp on a body of <bytes> instead of crawling."),
+            QStringLiteral("bytes"));
+    commandLineParser.addOption(extractorOption);
+    QCommandLineOption serveOption(QStringLiteral("serve"),
+            QStringLiteral("Internal: run the fake server farm and print its port."));
+    commandLineParser.addOption(serveOption);
+    commandLineParser.process(app);
+
+    if (commandLineParser.isSet(extractorOption)) {
+        benchmarkExtractor(commandLineParser.value(extractorOption).toInt());
+        return 0;
+    }
+
+    FakeServerFarm::Config config;
+    config.siteCount = commandLineParser.value(sitesOption).toInt();
+    config.handshakeLatency = commandLineParser.value(latencyOption).toInt();
+    config.linksPerPage = commandLineParser.value(linksOption).toInt();
+    config.redirectHops = commandLineParser.value(hopsOption).toInt();
+    config.redirectRatio = commandLineParser.value(redirectOption).toDouble();
+    config.stallRatio = commandLineParser.value(stallOption).toDouble();
+    config.unknownRatio = commandLineParser.value(unknownOption).toDouble();
+    config.deepLinkRatio = commandLineParser.value(deepLinkOption).toDouble();
+
+    if (commandLineParser.isSet(serveOption)) {
+        QTextStream out(stdout);
+        FakeServerFarm farm(config);
+        if (!farm.loadCertificates(commandLineParser.value(certificatesOption)))
+            qFatal("could not load the certificates from %s", qPrintable(commandLineParser.value(certificatesOption)));
+        if (!farm.listen(QHostAddress::LocalHost))
+            qFatal("could not listen: %s", qPrintable(farm.errorString()));
+        farm.setContactLog(&out);
+        out << farm.serverPort() << endl;
+        return app.exec();
+    }
+
+    // the server gets the same farm options as we do
+    QStringList serverArguments = app.arguments().mid(1);
+    serverArguments.removeAll(QStringLiteral("--probe"));
+    CrawlBenchmark benchmark(config, serverArguments);
+    benchmark.setCertificateDirectory(commandLineParser.value(certificatesOption));
+    benchmark.setProbeMode(commandLineParser.isSet(probeOption));
+    benchmark.setTimeout(commandLineParser.value(timeoutOption).toInt());
+    QMetaObject::invokeMethod(&benchmark, "start", Qt::QueuedConnection);
+    return app.exec();
+}
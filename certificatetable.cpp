@@ -0,0 +1,58 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "certificatetable.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QStringList>
+
+CertificateTable::CertificateTable()
+{
+}
+
+int CertificateTable::intern(const QSslCertificate &certificate) {
+
+    QByteArray digest = certificate.digest(QCryptographicHash::Sha1);
+    QHash<QByteArray, int>::const_iterator it = m_ids.constFind(digest);
+    if (it != m_ids.constEnd())
+        return it.value();
+
+    // first time we see this certificate, extract the fields we need
+    int id = m_certificates.count();
+    m_certificates.append(describe(certificate));
+    m_ids.insert(m_certificates.last().fingerprint, id); // shares the bytes of the fingerprint
+    return id;
+}
+
+CertificateTable::Certificate CertificateTable::describe(const QSslCertificate &certificate,
+                                                         bool withIssuer) {
+    Certificate description;
+    description.fingerprint = certificate.digest(QCryptographicHash::Sha1);
+    description.subjectCountry = certificate.subjectInfo(QSslCertificate::CountryName).join(" / ");
+    if (withIssuer) {
+        description.issuerOrganization = certificate.issuerInfo(QSslCertificate::Organization).join(" / ");
+        description.issuerCountry = certificate.issuerInfo(QSslCertificate::CountryName).join(" / ");
+    }
+    if (certificate.expiryDate().isValid())
+        description.expiryDate = certificate.expiryDate().toMSecsSinceEpoch();
+    return description;
+}
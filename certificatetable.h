@@ -0,0 +1,63 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CERTIFICATETABLE_H
+#define CERTIFICATETABLE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+#include <QSslCertificate>
+
+// a few hundred intermediate and root certificates cover nearly all sites,
+// so every distinct one is parsed and stored only once and referred to
+// by its index in this table; site certificates are nearly all distinct
+// and are not interned but described inline
+class CertificateTable
+{
+public:
+    class Certificate {
+    public:
+        Certificate() : expiryDate(0) { }
+        QByteArray fingerprint; // SHA-1, raw bytes (written hex encoded)
+        QString subjectCountry;
+        QString issuerOrganization;
+        QString issuerCountry;
+        qint64 expiryDate; // msecs since epoch (UTC), 0 if unknown
+    };
+
+    CertificateTable();
+
+    // the fields of a certificate without adding it to the table; the issuer
+    // of a site certificate is only needed when the chain has no root
+    static Certificate describe(const QSslCertificate &certificate, bool withIssuer = true);
+
+    int intern(const QSslCertificate &certificate);
+    const Certificate &certificate(int id) const { return m_certificates.at(id); }
+    int count() const { return m_certificates.count(); }
+
+private:
+    QHash<QByteArray, int> m_ids; // SHA-1 digest -> index into m_certificates
+    QVector<Certificate> m_certificates;
+};
+
+#endif // CERTIFICATETABLE_H
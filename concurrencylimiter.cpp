@@ -0,0 +1,107 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "concurrencylimiter.h"
+
+#include <QtGlobal>
+
+// weight of a new sample in the moving averages
+static const double averageWeight = 0.05;
+// the latency is considered too high above this multiple of the baseline
+static const double latencyFactor = 2.5;
+static const double maxErrorRate = 0.5;
+
+ConcurrencyLimiter::ConcurrencyLimiter(int initialWindow, int floor, int ceiling) :
+    m_window(initialWindow),
+    m_floor(floor),
+    m_ceiling(ceiling),
+    m_latencyAverage(0),
+    m_latencyBaseline(0),
+    m_errorRate(0),
+    m_completedSinceDecrease(0)
+{
+    clamp();
+}
+
+void ConcurrencyLimiter::setLimits(int floor, int ceiling) {
+
+    m_floor = qMax(1, floor);
+    m_ceiling = qMax(m_floor, ceiling);
+    clamp();
+}
+
+void ConcurrencyLimiter::requestSucceeded(int latencyMsecs) {
+
+    completed();
+    m_errorRate *= (1 - averageWeight);
+    if (m_latencyAverage == 0)
+        m_latencyAverage = latencyMsecs;
+    else
+        m_latencyAverage += averageWeight * (latencyMsecs - m_latencyAverage);
+    if (m_latencyBaseline == 0 || m_latencyAverage < m_latencyBaseline)
+        m_latencyBaseline = m_latencyAverage;
+    else
+        m_latencyBaseline *= 1.001; // forget an old baseline eventually
+
+    if (m_latencyAverage > latencyFactor * m_latencyBaseline) {
+        decrease(0.9);
+    } else {
+        m_window += 1 / m_window; // one more per window of successful requests
+        clamp();
+    }
+}
+
+void ConcurrencyLimiter::requestFailed() {
+
+    completed();
+    m_errorRate += averageWeight * (1 - m_errorRate);
+    // most errors are the site's fault, only back off if there are lots of them
+    if (m_errorRate > maxErrorRate)
+        decrease(0.9);
+}
+
+void ConcurrencyLimiter::requestTimedOut() {
+
+    completed();
+    m_errorRate += averageWeight * (1 - m_errorRate);
+    decrease(0.5);
+}
+
+void ConcurrencyLimiter::completed() {
+
+    m_completedSinceDecrease++;
+}
+
+void ConcurrencyLimiter::decrease(double factor) {
+
+    // decrease at most once per window, the requests still in flight
+    // were sent before the last decrease had any effect
+    if (m_completedSinceDecrease < m_window)
+        return;
+    m_completedSinceDecrease = 0;
+    m_window *= factor;
+    clamp();
+}
+
+void ConcurrencyLimiter::clamp() {
+
+    m_window = qBound<double>(m_floor, m_window, m_ceiling);
+}
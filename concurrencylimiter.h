@@ -0,0 +1,57 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CONCURRENCYLIMITER_H
+#define CONCURRENCYLIMITER_H
+
+// decides how many requests may be in flight at the same time.
+// AIMD: the window grows by one per window of successful requests and
+// shrinks multiplicatively on timeouts, on a high error rate or when the
+// handshake latency rises well above the best latency seen so far.
+class ConcurrencyLimiter
+{
+public:
+    ConcurrencyLimiter(int initialWindow = 100, int floor = 20, int ceiling = 1000);
+
+    void setLimits(int floor, int ceiling);
+    int window() const { return static_cast<int>(m_window); }
+    int floor() const { return m_floor; }
+    int ceiling() const { return m_ceiling; }
+
+    void requestSucceeded(int latencyMsecs);
+    void requestFailed();
+    void requestTimedOut();
+
+private:
+    void completed();
+    void decrease(double factor);
+    void clamp();
+
+    double m_window;
+    int m_floor;
+    int m_ceiling;
+    double m_latencyAverage;  // exponentially weighted, in msecs
+    double m_latencyBaseline; // lowest average seen, slowly drifting upwards
+    double m_errorRate;       // exponentially weighted
+    int m_completedSinceDecrease;
+};
+
+#endif // CONCURRENCYLIMITER_H
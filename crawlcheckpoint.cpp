@@ -0,0 +1,348 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "crawlcheckpoint.h"
+#include "logging.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+
+#include <algorithm>
+
+static const quint32 snapshotMagic = 0x51534353; // "QSCS"
+static const quint32 snapshotVersion = 3;
+
+static void writeRequest(QDataStream &stream, const QNetworkRequest &request)
+{
+    stream << request.url().toEncoded()
+           << request.attribute(QNetworkRequest::User).toUrl().toEncoded()
+           << qint32(request.attribute(QtSslCrawler::s_tryCountAttribute).toInt());
+}
+
+static QNetworkRequest readRequest(QDataStream &stream)
+{
+    QByteArray url, originalUrl;
+    qint32 tryCount;
+    stream >> url >> originalUrl >> tryCount;
+    QNetworkRequest request(QUrl::fromEncoded(url));
+    request.setAttribute(QNetworkRequest::User, QUrl::fromEncoded(originalUrl));
+    if (tryCount > 0)
+        request.setAttribute(QtSslCrawler::s_tryCountAttribute, QVariant(tryCount));
+    return request;
+}
+
+// serializes and writes a snapshot and removes the logs it makes obsolete;
+// the frontier's containers are implicitly shared with the crawler's thread,
+// which detaches its own copies when it changes them
+class SnapshotWriterRunnable : public QRunnable
+{
+public:
+    SnapshotWriterRunnable(const QString &fileName, int generation,
+                           const CrawlFrontier::PendingRequests &pendingRequests,
+                           const VisitedUrlSet &visitedUrls, qint64 seedPosition, int seedLine,
+                           const QStringList &obsoleteLogs) :
+        m_fileName(fileName), m_generation(generation), m_pendingRequests(pendingRequests),
+        m_visitedUrls(visitedUrls), m_seedPosition(seedPosition), m_seedLine(seedLine),
+        m_obsoleteLogs(obsoleteLogs) { }
+    void run() {
+        QSaveFile file(m_fileName); // the old snapshot stays valid until commit()
+        if (file.open(QIODevice::WriteOnly)) {
+            QDataStream stream(&file);
+            QList<QNetworkRequest> pendingRequests = m_pendingRequests.toList();
+            stream << snapshotMagic << snapshotVersion << qint32(m_generation) << m_seedPosition
+                   << qint32(m_seedLine) << qint32(pendingRequests.count());
+            foreach (const QNetworkRequest &request, pendingRequests)
+                writeRequest(stream, request);
+            stream << m_visitedUrls;
+            if (stream.status() != QDataStream::Ok)
+                file.cancelWriting();
+        }
+        if (!file.commit()) {
+            qCWarning(lcStorage, "event=snapshot_failed file=%s", qUtf8Printable(m_fileName));
+            return;
+        }
+        foreach (const QString &logFile, m_obsoleteLogs)
+            QFile::remove(logFile);
+    }
+private:
+    const QString m_fileName;
+    const int m_generation;
+    const CrawlFrontier::PendingRequests m_pendingRequests;
+    const VisitedUrlSet m_visitedUrls;
+    const qint64 m_seedPosition;
+    const int m_seedLine;
+    const QStringList m_obsoleteLogs;
+};
+
+CrawlCheckpoint::CrawlCheckpoint(const QString &baseName) :
+    m_baseName(baseName),
+    m_loaded(false),
+    m_generation(0),
+    m_logFile(),
+    m_log(&m_logFile),
+    m_resultsFile(baseName + QStringLiteral(".results")),
+    m_results(&m_resultsFile)
+{
+    m_snapshotThreadPool.setMaxThreadCount(1);
+}
+
+CrawlCheckpoint::~CrawlCheckpoint() {
+
+    flush();
+    m_snapshotThreadPool.waitForDone();
+}
+
+QString CrawlCheckpoint::logFileName(int generation) const {
+
+    return m_baseName + QStringLiteral(".log.") + QString::number(generation);
+}
+
+QList<int> CrawlCheckpoint::logGenerations() const {
+
+    QFileInfo baseInfo(m_baseName);
+    QString prefix = baseInfo.fileName() + QStringLiteral(".log.");
+    QList<int> generations;
+    foreach (const QString &fileName, baseInfo.dir().entryList(QStringList(prefix + QLatin1Char('*')), QDir::Files)) {
+        bool ok;
+        int generation = fileName.mid(prefix.length()).toInt(&ok);
+        if (ok)
+            generations.append(generation);
+    }
+    std::sort(generations.begin(), generations.end());
+    return generations;
+}
+
+bool CrawlCheckpoint::load(QList<QNetworkRequest> *pendingRequests, VisitedUrlSet *visitedUrls,
+                           qint64 *seedPosition, int *seedLine, QList<CrawlResult> *results) {
+
+    QHash<QUrl, QNetworkRequest> pending;
+    QList<QUrl> pendingOrder;
+    VisitedUrlSet &visited = *visitedUrls;
+    int firstGeneration = 0;
+
+    QFile snapshotFile(m_baseName + QStringLiteral(".snapshot"));
+    if (snapshotFile.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&snapshotFile);
+        quint32 magic, version;
+        qint32 generation, line, pendingCount;
+        stream >> magic >> version;
+        if (magic != snapshotMagic || version != snapshotVersion) {
+            qCWarning(lcStorage, "event=snapshot_unreadable file=%s reason=unknown_format",
+                      qUtf8Printable(snapshotFile.fileName()));
+            return false;
+        }
+        stream >> generation >> *seedPosition >> line >> pendingCount;
+        *seedLine = line;
+        firstGeneration = generation;
+        for (int a = 0; a < pendingCount && stream.status() == QDataStream::Ok; a++) {
+            QNetworkRequest request = readRequest(stream);
+            pending.insert(request.url(), request);
+            pendingOrder.append(request.url());
+        }
+        stream >> visited;
+        if (stream.status() != QDataStream::Ok) {
+            qCWarning(lcStorage, "event=snapshot_unreadable file=%s reason=truncated",
+                      qUtf8Printable(snapshotFile.fileName()));
+            return false;
+        }
+    }
+
+    // replay everything that happened after the snapshot; a log might end
+    // with an incomplete record if we crashed while writing it
+    foreach (int generation, logGenerations()) {
+        m_generation = qMax(m_generation, generation);
+        if (generation < firstGeneration)
+            continue;
+        QFile logFile(logFileName(generation));
+        if (!logFile.open(QIODevice::ReadOnly))
+            continue;
+        QDataStream stream(&logFile);
+        while (!stream.atEnd()) {
+            quint8 type;
+            stream >> type;
+            if (type == 'Q') {
+                QNetworkRequest request = readRequest(stream);
+                if (stream.status() == QDataStream::Ok && !pending.contains(request.url())
+                    && !visited.contains(request.url())) {
+                    pending.insert(request.url(), request);
+                    pendingOrder.append(request.url());
+                }
+            } else if (type == 'V') {
+                QByteArray encodedUrl;
+                stream >> encodedUrl;
+                QUrl url = QUrl::fromEncoded(encodedUrl);
+                visited.insert(url);
+                pending.remove(url);
+            } else if (type == 'P') {
+                qint32 line;
+                stream >> *seedPosition >> line;
+                if (stream.status() == QDataStream::Ok)
+                    *seedLine = line;
+            } else {
+                break;
+            }
+            if (stream.status() != QDataStream::Ok)
+                break;
+        }
+    }
+
+    foreach (const QUrl &url, pendingOrder) {
+        if (pending.contains(url)) // a URL might be in the list more than once after retries
+            pendingRequests->append(pending.take(url));
+    }
+    m_loaded = true;
+    return loadResults(results);
+}
+
+bool CrawlCheckpoint::loadResults(QList<CrawlResult> *results) {
+
+    if (!m_resultsFile.open(QIODevice::ReadWrite))
+        return false;
+    QHash<qint32, QSslCertificate> certificates;
+    qint64 lastCompleteRecord = 0;
+    while (!m_results.atEnd()) {
+        quint8 type;
+        m_results >> type;
+        if (type == 'C') {
+            qint32 id;
+            QByteArray der;
+            m_results >> id >> der;
+            if (m_results.status() != QDataStream::Ok)
+                break;
+            QSslCertificate certificate(der, QSsl::Der);
+            certificates.insert(id, certificate);
+            m_loggedCertificates.insert(certificate, id);
+        } else if (type == 'R') {
+            QByteArray originalUrl, urlWithCertificate;
+            QList<qint32> chain;
+            m_results >> originalUrl >> urlWithCertificate >> chain;
+            if (m_results.status() != QDataStream::Ok)
+                break;
+            CrawlResult result;
+            result.originalUrl = QUrl::fromEncoded(originalUrl);
+            result.urlWithCertificate = QUrl::fromEncoded(urlWithCertificate);
+            foreach (qint32 id, chain)
+                result.certificateChain.append(certificates.value(id));
+            results->append(result);
+        } else {
+            break;
+        }
+        lastCompleteRecord = m_resultsFile.pos();
+    }
+    // cut off an incomplete record, we are going to append to the file
+    m_results.resetStatus();
+    m_resultsFile.resize(lastCompleteRecord);
+    m_resultsFile.close();
+    return true;
+}
+
+bool CrawlCheckpoint::open() {
+
+    if (!m_loaded) {
+        // not resuming, start from scratch
+        QFile::remove(m_baseName + QStringLiteral(".snapshot"));
+        foreach (int generation, logGenerations())
+            QFile::remove(logFileName(generation));
+        if (!m_resultsFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            return false;
+    } else if (!m_resultsFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+    return startLog(m_generation + 1);
+}
+
+bool CrawlCheckpoint::startLog(int generation) {
+
+    if (m_logFile.isOpen())
+        m_logFile.close();
+    m_generation = generation;
+    m_logFile.setFileName(logFileName(generation));
+    m_log.resetStatus();
+    return m_logFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
+}
+
+void CrawlCheckpoint::requestQueued(const QNetworkRequest &request) {
+
+    m_log << quint8('Q');
+    writeRequest(m_log, request);
+}
+
+void CrawlCheckpoint::urlVisited(const QUrl &url) {
+
+    m_log << quint8('V') << url.toEncoded();
+}
+
+void CrawlCheckpoint::seedPositionChanged(qint64 position, int line) {
+
+    m_log << quint8('P') << position << qint32(line);
+}
+
+void CrawlCheckpoint::resultFound(const CrawlResult &result) {
+
+    // the same intermediate and root certificates appear in most chains,
+    // so every certificate is only written once
+    QList<qint32> chain;
+    foreach (const QSslCertificate &certificate, result.certificateChain) {
+        QHash<QSslCertificate, qint32>::const_iterator it = m_loggedCertificates.constFind(certificate);
+        if (it == m_loggedCertificates.constEnd()) {
+            qint32 id = m_loggedCertificates.count();
+            m_results << quint8('C') << id << certificate.toDer();
+            it = m_loggedCertificates.insert(certificate, id);
+        }
+        chain.append(it.value());
+    }
+    m_results << quint8('R') << result.originalUrl.toEncoded() << result.urlWithCertificate.toEncoded() << chain;
+}
+
+void CrawlCheckpoint::flush() {
+
+    if (m_logFile.isOpen())
+        m_logFile.flush();
+    if (m_resultsFile.isOpen())
+        m_resultsFile.flush();
+}
+
+void CrawlCheckpoint::writeSnapshot(const CrawlFrontier::PendingRequests &pendingRequests,
+                                    const VisitedUrlSet &visitedUrls, qint64 seedPosition, int seedLine) {
+
+    if (m_snapshotThreadPool.activeThreadCount() > 0)
+        return;
+
+    // everything logged from now on is not part of the snapshot
+    // and goes to the next log generation
+    int generation = m_generation + 1;
+
+    QStringList obsoleteLogs;
+    foreach (int oldGeneration, logGenerations()) {
+        if (oldGeneration < generation)
+            obsoleteLogs.append(logFileName(oldGeneration));
+    }
+    flush();
+    if (!startLog(generation)) {
+        qCWarning(lcStorage, "event=log_open_failed file=%s", qUtf8Printable(m_logFile.fileName()));
+        return;
+    }
+    m_snapshotThreadPool.start(new SnapshotWriterRunnable(m_baseName + QStringLiteral(".snapshot"),
+                                                          generation, pendingRequests, visitedUrls,
+                                                          seedPosition, seedLine, obsoleteLogs));
+}
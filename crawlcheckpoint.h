@@ -0,0 +1,88 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CRAWLCHECKPOINT_H
+#define CRAWLCHECKPOINT_H
+
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QNetworkRequest>
+#include <QSslCertificate>
+#include <QThreadPool>
+#include <QUrl>
+
+#include "crawlfrontier.h"
+#include "qt-ssl-crawler.h"
+#include "visitedurlset.h"
+
+// makes a crawl resumable. Files, all starting with the base name:
+//  .snapshot   compacted state of the frontier and the seed position,
+//              replaced atomically
+//  .log.<n>    append-only log of the frontier changes since snapshot n,
+//              a new generation is started with every snapshot
+//  .results    append-only log of all results, never compacted
+// Snapshots are taken as implicitly shared copies of the frontier, and
+// serialized and written to disk in a background thread.
+class CrawlCheckpoint
+{
+public:
+    explicit CrawlCheckpoint(const QString &baseName);
+    ~CrawlCheckpoint();
+
+    // reads the last snapshot and replays all logs written after it;
+    // call before open(). Without a snapshot, visitedUrls keeps its mode.
+    bool load(QList<QNetworkRequest> *pendingRequests, VisitedUrlSet *visitedUrls,
+              qint64 *seedPosition, int *seedLine, QList<CrawlResult> *results);
+    // without load(), all files of a previous crawl are removed
+    bool open();
+
+    void requestQueued(const QNetworkRequest &request);
+    void urlVisited(const QUrl &url);
+    void seedPositionChanged(qint64 position, int line);
+    void resultFound(const CrawlResult &result);
+    void flush();
+
+    // starts a new log generation and writes the snapshot in the background;
+    // does nothing if the previous snapshot is still being written. The
+    // arguments are copied, they must not be shared with other threads.
+    void writeSnapshot(const CrawlFrontier::PendingRequests &pendingRequests,
+                       const VisitedUrlSet &visitedUrls, qint64 seedPosition, int seedLine);
+
+private:
+    QString logFileName(int generation) const;
+    QList<int> logGenerations() const;
+    bool startLog(int generation);
+    bool loadResults(QList<CrawlResult> *results);
+
+    QString m_baseName;
+    bool m_loaded;
+    int m_generation;
+    QFile m_logFile;
+    QDataStream m_log;
+    QFile m_resultsFile;
+    QDataStream m_results;
+    QHash<QSslCertificate, qint32> m_loggedCertificates;
+    QThreadPool m_snapshotThreadPool;
+};
+
+#endif // CRAWLCHECKPOINT_H
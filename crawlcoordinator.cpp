@@ -0,0 +1,205 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "crawlcoordinator.h"
+#include "workerchannel.h"
+#include "sharding.h"
+#include "logging.h"
+
+#include <QCoreApplication>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+CrawlCoordinator::CrawlCoordinator(int workerCount, const QStringList &workerArguments, QObject *parent) :
+    QObject(parent),
+    m_workerCount(workerCount),
+    m_workerArguments(workerArguments),
+    m_workerProgram(QCoreApplication::applicationFilePath()),
+    m_server(new QLocalServer(this)),
+    m_processes(workerCount, 0),
+    m_channels(workerCount, 0),
+    m_queuedUrls(workerCount),
+    m_routedUrlsSent(workerCount, 0),
+    m_shardIdle(workerCount, false),
+    m_workerGone(workerCount, false),
+    m_finished(false)
+{
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(workerConnected()));
+}
+
+CrawlCoordinator::~CrawlCoordinator() {
+
+    // give the workers time to write their checkpoints
+    foreach (QProcess *process, m_processes) {
+        if (process && process->state() != QProcess::NotRunning && !process->waitForFinished(30000)) {
+            qCWarning(lcShards, "event=worker_killed pid=%lld", qint64(process->processId()));
+            process->kill();
+            process->waitForFinished();
+        }
+    }
+}
+
+void CrawlCoordinator::start() {
+
+    QString serverName = QStringLiteral("qt-ssl-crawl-%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(serverName); // left over from a crashed run
+    if (!m_server->listen(serverName)) {
+        qFatal("could not listen on local socket %s: %s", qPrintable(serverName),
+               qPrintable(m_server->errorString()));
+    }
+    for (int a = 0; a < m_workerCount; a++) {
+        QProcess *process = new QProcess(this);
+        process->setProcessChannelMode(QProcess::ForwardedChannels); // logs go to our stderr
+        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)),
+                this, SLOT(workerExited(int,QProcess::ExitStatus)));
+        // a worker which does not start never emits finished()
+        connect(process, SIGNAL(error(QProcess::ProcessError)),
+                this, SLOT(workerError(QProcess::ProcessError)));
+        QStringList arguments = m_workerArguments;
+        arguments << QStringLiteral("--coordinator") << serverName
+                  << QStringLiteral("--worker-shard") << QString::number(a)
+                  << QStringLiteral("--worker-shards") << QString::number(m_workerCount);
+        m_processes[a] = process;
+        process->start(m_workerProgram, arguments);
+    }
+    qCWarning(lcShards, "event=workers_started workers=%d server=%s", m_workerCount, qUtf8Printable(serverName));
+}
+
+void CrawlCoordinator::workerConnected() {
+
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        // we only know which worker it is after its hello message
+        WorkerChannel *channel = new WorkerChannel(socket, this);
+        connect(channel, SIGNAL(helloReceived(int)), this, SLOT(workerHello(int)));
+        connect(channel, SIGNAL(resultsReceived(QList<CrawlResult>)),
+                this, SLOT(workerResults(QList<CrawlResult>)));
+        connect(channel, SIGNAL(urlsReceived(QList<FoundUrl>)), this, SLOT(routeUrls(QList<FoundUrl>)));
+        connect(channel, SIGNAL(idleReceived(int)), this, SLOT(workerIdle(int)));
+    }
+}
+
+void CrawlCoordinator::workerHello(int shardIndex) {
+
+    WorkerChannel *channel = qobject_cast<WorkerChannel *>(sender());
+    if (shardIndex < 0 || shardIndex >= m_workerCount || m_channels.at(shardIndex)) {
+        qCWarning(lcShards, "event=unexpected_hello shard=%d", shardIndex);
+        return;
+    }
+    m_channels[shardIndex] = channel;
+    if (!m_queuedUrls.at(shardIndex).isEmpty()) {
+        channel->sendUrls(m_queuedUrls.at(shardIndex));
+        m_queuedUrls[shardIndex].clear();
+    }
+}
+
+void CrawlCoordinator::workerResults(const QList<CrawlResult> &results) {
+
+    foreach (const CrawlResult &result, results)
+        emit crawlResult(result.originalUrl, result.urlWithCertificate, result.certificateChain);
+}
+
+void CrawlCoordinator::routeUrls(const QList<FoundUrl> &urls) {
+
+    // see CrawlerPool::routeUrls()
+    QVector<QList<FoundUrl> > batches(m_workerCount);
+    foreach (const FoundUrl &url, urls) {
+        int target = shardForHost(url.url.host(), m_workerCount);
+        if (m_workerGone.at(target)) {
+            qCDebug(lcShards, "event=drop_url url=%s reason=worker_gone shard=%d",
+                    qUtf8Printable(url.url.toString()), target);
+            continue;
+        }
+        batches[target].append(url);
+    }
+    for (int target = 0; target < m_workerCount; target++) {
+        if (batches.at(target).isEmpty())
+            continue;
+        m_routedUrlsSent[target] += batches.at(target).count();
+        m_shardIdle[target] = false;
+        if (WorkerChannel *channel = m_channels.at(target))
+            channel->sendUrls(batches.at(target));
+        else
+            m_queuedUrls[target] += batches.at(target);
+    }
+}
+
+void CrawlCoordinator::workerIdle(int routedUrlsReceived) {
+
+    int index = shardIndex(sender());
+    if (index < 0)
+        return;
+    // see CrawlerPool::shardIdle()
+    m_shardIdle[index] = (routedUrlsReceived == m_routedUrlsSent.at(index));
+    checkIfFinished();
+}
+
+void CrawlCoordinator::workerExited(int exitCode, QProcess::ExitStatus exitStatus) {
+
+    if (m_finished)
+        return;
+    int index = m_processes.indexOf(qobject_cast<QProcess *>(sender()));
+    qCWarning(lcShards, "event=worker_exited shard=%d exit_code=%d crashed=%d",
+              index, exitCode, exitStatus == QProcess::CrashExit);
+    shardFailed(index);
+}
+
+void CrawlCoordinator::workerError(QProcess::ProcessError error) {
+
+    // crashes and the like are followed by finished(), see workerExited()
+    if (m_finished || error != QProcess::FailedToStart)
+        return;
+    QProcess *process = qobject_cast<QProcess *>(sender());
+    int index = m_processes.indexOf(process);
+    qCWarning(lcShards, "event=worker_failed_to_start shard=%d error=%s",
+              index, qUtf8Printable(process->errorString()));
+    shardFailed(index);
+}
+
+void CrawlCoordinator::shardFailed(int index) {
+
+    // the hosts of the shard are not crawled, the URLs routed to it
+    // are dropped and the other workers can finish
+    m_workerGone[index] = true;
+    m_shardIdle[index] = true;
+    checkIfFinished();
+}
+
+void CrawlCoordinator::checkIfFinished() {
+
+    if (m_finished || m_shardIdle.contains(false))
+        return;
+    m_finished = true;
+    qCWarning(lcShards, "event=crawl_finished workers=%d", m_workerCount);
+    foreach (WorkerChannel *channel, m_channels) {
+        if (channel && channel->socket()->state() == QLocalSocket::ConnectedState)
+            channel->sendQuit();
+    }
+    emit crawlFinished();
+}
+
+int CrawlCoordinator::shardIndex(QObject *channel) const {
+
+    for (int a = 0; a < m_channels.count(); a++) {
+        if (m_channels.at(a) == channel)
+            return a;
+    }
+    return -1;
+}
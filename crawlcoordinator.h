@@ -0,0 +1,89 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CRAWLCOORDINATOR_H
+#define CRAWLCOORDINATOR_H
+
+#include "qt-ssl-crawler.h"
+
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+#include <QVector>
+
+class QLocalServer;
+class WorkerChannel;
+
+// runs the crawl in worker processes (this executable started with
+// --coordinator, see CrawlWorker), each owning the hosts with
+// shardForHost(host, workerCount) == its index. Like CrawlerPool, URLs
+// found for hosts of another worker are routed through here, and the
+// results of all workers come out of our crawlResult() signal, so one
+// ResultParser merges them.
+class CrawlCoordinator : public QObject
+{
+    Q_OBJECT
+public:
+    // workerArguments are passed to every worker in addition to the
+    // ones telling it its shard
+    CrawlCoordinator(int workerCount, const QStringList &workerArguments, QObject *parent = 0);
+    ~CrawlCoordinator();
+
+    // the executable of the workers, this one by default
+    void setWorkerProgram(const QString &program) { m_workerProgram = program; }
+
+signals:
+    void crawlResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                     const QList<QSslCertificate> &certificateChain);
+    void crawlFinished();
+
+public slots:
+    void start();
+
+private slots:
+    void workerConnected();
+    void workerHello(int shardIndex);
+    void workerResults(const QList<CrawlResult> &results);
+    void routeUrls(const QList<FoundUrl> &urls);
+    void workerIdle(int routedUrlsReceived);
+    void workerExited(int exitCode, QProcess::ExitStatus exitStatus);
+    void workerError(QProcess::ProcessError error);
+
+private:
+    int shardIndex(QObject *channel) const;
+    void shardFailed(int index);
+    void checkIfFinished();
+
+    int m_workerCount;
+    QStringList m_workerArguments;
+    QString m_workerProgram;
+    QLocalServer *m_server;
+    QVector<QProcess *> m_processes;
+    QVector<WorkerChannel *> m_channels;
+    // URLs for workers which have not connected yet
+    QVector<QList<FoundUrl> > m_queuedUrls;
+    QVector<int> m_routedUrlsSent;
+    QVector<bool> m_shardIdle;
+    QVector<bool> m_workerGone;
+    bool m_finished;
+};
+
+#endif // CRAWLCOORDINATOR_H
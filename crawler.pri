@@ -0,0 +1,58 @@
+# the crawler itself, shared by the application and the benchmark in bench/
+
+INCLUDEPATH += $$PWD
+
+# qCDebug() calls are compiled out, see logging.h
+CONFIG(release, debug|release): DEFINES += QT_NO_DEBUG_OUTPUT
+
+SOURCES += \
+    $$PWD/qt-ssl-crawler.cpp \
+    $$PWD/resultparser.cpp \
+    $$PWD/resultqueue.cpp \
+    $$PWD/crawlfrontier.cpp \
+    $$PWD/domainsource.cpp \
+    $$PWD/crawlerpool.cpp \
+    $$PWD/concurrencylimiter.cpp \
+    $$PWD/urlextractor.cpp \
+    $$PWD/certificatetable.cpp \
+    $$PWD/resultwriter.cpp \
+    $$PWD/crawlcheckpoint.cpp \
+    $$PWD/visitedurlset.cpp \
+    $$PWD/hostresolver.cpp \
+    $$PWD/deadlinescheduler.cpp \
+    $$PWD/workerchannel.cpp \
+    $$PWD/crawlcoordinator.cpp \
+    $$PWD/crawlworker.cpp \
+    $$PWD/logging.cpp \
+    $$PWD/metrics.cpp \
+    $$PWD/metricsexporter.cpp \
+    $$PWD/recrawlplanner.cpp \
+    $$PWD/aggregates.cpp \
+    $$PWD/retrypolicy.cpp
+
+HEADERS += \
+    $$PWD/qt-ssl-crawler.h \
+    $$PWD/resultparser.h \
+    $$PWD/resultqueue.h \
+    $$PWD/crawlfrontier.h \
+    $$PWD/seedsource.h \
+    $$PWD/domainsource.h \
+    $$PWD/crawlerpool.h \
+    $$PWD/sharding.h \
+    $$PWD/concurrencylimiter.h \
+    $$PWD/urlextractor.h \
+    $$PWD/certificatetable.h \
+    $$PWD/resultwriter.h \
+    $$PWD/crawlcheckpoint.h \
+    $$PWD/visitedurlset.h \
+    $$PWD/hostresolver.h \
+    $$PWD/deadlinescheduler.h \
+    $$PWD/workerchannel.h \
+    $$PWD/crawlcoordinator.h \
+    $$PWD/crawlworker.h \
+    $$PWD/logging.h \
+    $$PWD/metrics.h \
+    $$PWD/metricsexporter.h \
+    $$PWD/recrawlplanner.h \
+    $$PWD/aggregates.h \
+    $$PWD/retrypolicy.h
@@ -0,0 +1,180 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "crawlerpool.h"
+#include "sharding.h"
+#include "logging.h"
+#include "metrics.h"
+
+#include <QThread>
+
+CrawlerPool::CrawlerPool(int threadCount, QObject *parent, int from, int to) :
+    QObject(parent),
+    m_routedUrlsSent(threadCount, 0),
+    m_shardIdle(threadCount, false),
+    m_finished(false)
+{
+    qRegisterMetaType<CrawlResult>("CrawlResult");
+    qRegisterMetaType<QList<CrawlResult> >("QList<CrawlResult>");
+    qRegisterMetaType<FoundUrl>("FoundUrl");
+    qRegisterMetaType<QList<FoundUrl> >("QList<FoundUrl>");
+
+    for (int a = 0; a < threadCount; a++) {
+        // the crawlers are created here one after the other, so only
+        // the first one might need to build the line index of the domain file
+        QtSslCrawler *crawler = new QtSslCrawler(0, from, to);
+        crawler->setShard(a, threadCount);
+        QThread *thread = new QThread(this);
+        crawler->moveToThread(thread);
+        connect(thread, SIGNAL(finished()), crawler, SLOT(deleteLater()));
+        connect(crawler, SIGNAL(crawlResults(QList<CrawlResult>)),
+                this, SLOT(shardResults(QList<CrawlResult>)));
+        connect(crawler, SIGNAL(foreignUrlsFound(QList<FoundUrl>)), this, SLOT(routeUrls(QList<FoundUrl>)));
+        connect(crawler, SIGNAL(idle(int)), this, SLOT(shardIdle(int)));
+        m_crawlers.append(crawler);
+        m_threads.append(thread);
+    }
+}
+
+CrawlerPool::~CrawlerPool() {
+
+    foreach (QThread *thread, m_threads) {
+        thread->quit();
+        thread->wait();
+    }
+}
+
+void CrawlerPool::setConcurrencyLimits(int floor, int ceiling) {
+
+    // the threads are not running yet, so this is safe
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setConcurrencyLimits(floor, ceiling);
+}
+
+void CrawlerPool::setProbeMode(bool probeMode) {
+
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setProbeMode(probeMode);
+}
+
+void CrawlerPool::setMaxBodySize(qint64 bytes) {
+
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setMaxBodySize(bytes);
+}
+
+void CrawlerPool::setHostResolution(int maxConcurrentLookups, int negativeCacheTime) {
+
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setHostResolution(maxConcurrentLookups, negativeCacheTime);
+}
+
+void CrawlerPool::setTimeouts(int connectTimeout, int handshakeTimeout, int totalTimeout) {
+
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setTimeouts(connectTimeout, handshakeTimeout, totalTimeout);
+}
+
+void CrawlerPool::setRetryPolicy(int maxRetries, int retryDelay) {
+
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setRetryPolicy(maxRetries, retryDelay);
+}
+
+void CrawlerPool::setFallbackDelay(int delay) {
+
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setFallbackDelay(delay);
+}
+
+void CrawlerPool::setRecrawlPlan(const QSharedPointer<const RecrawlPlan> &plan, qint64 timeBudget) {
+
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setRecrawlPlan(plan, timeBudget);
+}
+
+void CrawlerPool::setCheckpoint(const QString &baseName, bool resume) {
+
+    for (int a = 0; a < m_crawlers.count(); a++)
+        m_crawlers.at(a)->setCheckpoint(baseName + QLatin1Char('.') + QString::number(a), resume);
+}
+
+void CrawlerPool::setVisitedUrlSetMode(VisitedUrlSet::Mode mode, qint64 bloomFilterCapacity,
+                                       double bloomFilterFalsePositiveRate) {
+
+    // every crawler only sees the URLs of its own hosts
+    qint64 capacityPerCrawler = bloomFilterCapacity / m_crawlers.count() + 1;
+    foreach (QtSslCrawler *crawler, m_crawlers)
+        crawler->setVisitedUrlSetMode(mode, capacityPerCrawler, bloomFilterFalsePositiveRate);
+}
+
+void CrawlerPool::start() {
+
+    for (int a = 0; a < m_crawlers.count(); a++) {
+        m_threads.at(a)->start();
+        QMetaObject::invokeMethod(m_crawlers.at(a), "start", Qt::QueuedConnection);
+    }
+}
+
+void CrawlerPool::shardResults(const QList<CrawlResult> &results) {
+
+    foreach (const CrawlResult &result, results)
+        emit crawlResult(result.originalUrl, result.urlWithCertificate, result.certificateChain);
+}
+
+void CrawlerPool::routeUrls(const QList<FoundUrl> &urls) {
+
+    // one call per target crawler, not per URL
+    QVector<QList<FoundUrl> > batches(m_crawlers.count());
+    foreach (const FoundUrl &url, urls)
+        batches[shardForHost(url.url.host(), m_crawlers.count())].append(url);
+    for (int target = 0; target < batches.count(); target++) {
+        if (batches.at(target).isEmpty())
+            continue;
+        m_routedUrlsSent[target] += batches.at(target).count();
+        m_shardIdle[target] = false;
+        CrawlMetrics::instance().routedUrlBatches->increment();
+        QMetaObject::invokeMethod(m_crawlers.at(target), "addRoutedUrls", Qt::QueuedConnection,
+                                  Q_ARG(QList<FoundUrl>, batches.at(target)));
+    }
+}
+
+void CrawlerPool::shardIdle(int routedUrlsReceived) {
+
+    int index = shardIndex(sender());
+    // if the crawler has not seen all URLs we routed to it yet,
+    // it will report again after processing them
+    m_shardIdle[index] = (routedUrlsReceived == m_routedUrlsSent.at(index));
+    if (m_finished || m_shardIdle.contains(false))
+        return;
+    m_finished = true;
+    qCWarning(lcShards, "event=crawl_finished threads=%d", m_crawlers.count());
+    emit crawlFinished();
+}
+
+int CrawlerPool::shardIndex(QObject *crawler) const {
+
+    for (int a = 0; a < m_crawlers.count(); a++) {
+        if (m_crawlers.at(a) == crawler)
+            return a;
+    }
+    return -1;
+}
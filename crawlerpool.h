@@ -0,0 +1,83 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CRAWLERPOOL_H
+#define CRAWLERPOOL_H
+
+#include "qt-ssl-crawler.h"
+
+#include <QObject>
+#include <QVector>
+
+class QThread;
+
+// runs one QtSslCrawler (with its own QNetworkAccessManager) per thread.
+// Hosts are assigned to the crawlers by hash, URLs found by one crawler
+// for a host of another one are routed through the pool.
+// Offers the same signals as QtSslCrawler, so a ResultParser can be attached.
+class CrawlerPool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CrawlerPool(int threadCount, QObject *parent = 0, int from = 0, int to = 0);
+    ~CrawlerPool();
+
+    // limits for each of the crawlers, call before start()
+    void setConcurrencyLimits(int floor, int ceiling);
+    void setProbeMode(bool probeMode);
+    void setMaxBodySize(qint64 bytes);
+    void setHostResolution(int maxConcurrentLookups, int negativeCacheTime);
+    void setTimeouts(int connectTimeout, int handshakeTimeout, int totalTimeout);
+    void setRetryPolicy(int maxRetries, int retryDelay);
+    void setFallbackDelay(int delay);
+    // all crawlers share the plan, each checks the sites of its hosts
+    void setRecrawlPlan(const QSharedPointer<const RecrawlPlan> &plan, qint64 timeBudget);
+    // every crawler thread has its own checkpoint files (baseName.<thread>),
+    // so a resumed crawl needs the same number of threads
+    void setCheckpoint(const QString &baseName, bool resume);
+    // the Bloom filter capacity is for all crawlers together
+    void setVisitedUrlSetMode(VisitedUrlSet::Mode mode, qint64 bloomFilterCapacity,
+                              double bloomFilterFalsePositiveRate);
+
+signals:
+    void crawlResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                     const QList<QSslCertificate> &certificateChain);
+    void crawlFinished();
+
+public slots:
+    void start();
+
+private slots:
+    void shardResults(const QList<CrawlResult> &results);
+    void routeUrls(const QList<FoundUrl> &urls);
+    void shardIdle(int routedUrlsReceived);
+
+private:
+    int shardIndex(QObject *crawler) const;
+
+    QVector<QThread *> m_threads;
+    QVector<QtSslCrawler *> m_crawlers;
+    QVector<int> m_routedUrlsSent;
+    QVector<bool> m_shardIdle;
+    bool m_finished;
+};
+
+#endif // CRAWLERPOOL_H
@@ -0,0 +1,170 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "crawlfrontier.h"
+#include "seedsource.h"
+#include "crawlcheckpoint.h"
+
+CrawlFrontier::CrawlFrontier() :
+    m_seedSource(0),
+    m_checkpoint(0)
+{
+    m_clock.start();
+}
+
+bool CrawlFrontier::enqueueIfNew(const QNetworkRequest &request, bool first) {
+
+    QUrl url = normalizedUrl(request.url());
+    if (m_visitedUrls.contains(url))
+        return false;
+    UrlState &urlState = m_urlStates[url];
+    if (urlState != Unknown)
+        return false;
+    urlState = Pending;
+    QNetworkRequest normalizedRequest(request);
+    normalizedRequest.setUrl(url);
+    if (first)
+        m_requestsToSend.prepend(normalizedRequest);
+    else
+        m_requestsToSend.enqueue(normalizedRequest);
+    if (m_checkpoint)
+        m_checkpoint->requestQueued(normalizedRequest);
+    return true;
+}
+
+QUrl CrawlFrontier::normalizedUrl(const QUrl &url) {
+
+    QUrl normalized = url.adjusted(QUrl::RemoveFragment | QUrl::StripTrailingSlash);
+    if (normalized.path() == QLatin1String("/")) // not stripped by QUrl
+        normalized.setPath(QString());
+    return normalized;
+}
+
+CrawlFrontier::UrlState CrawlFrontier::state(const QUrl &url) const {
+
+    UrlState urlState = m_urlStates.value(url, Unknown);
+    if (urlState == Unknown && m_visitedUrls.contains(url))
+        return Visited;
+    return urlState;
+}
+
+bool CrawlFrontier::hasPending() {
+
+    releaseDelayed();
+    pullSeeds();
+    return !m_requestsToSend.isEmpty();
+}
+
+bool CrawlFrontier::isIdle() const {
+
+    return m_requestsToSend.isEmpty() && m_inFlightRequests.isEmpty() && m_delayedRequests.isEmpty()
+            && (!m_seedSource || m_seedSource->atEnd());
+}
+
+QNetworkRequest CrawlFrontier::takeNext() {
+
+    releaseDelayed();
+    pullSeeds();
+    QNetworkRequest request = m_requestsToSend.dequeue();
+    m_urlStates.insert(request.url(), InFlight);
+    m_inFlightRequests.insert(request.url(), request);
+    return request;
+}
+
+void CrawlFrontier::markVisited(const QUrl &url) {
+
+    QHash<QUrl, UrlState>::iterator it = m_urlStates.find(url);
+    if (it == m_urlStates.end() || it.value() == Delayed)
+        return;
+    if (it.value() == InFlight)
+        m_inFlightRequests.remove(url);
+    m_urlStates.erase(it);
+    m_visitedUrls.insert(url);
+    if (m_checkpoint)
+        m_checkpoint->urlVisited(url);
+}
+
+void CrawlFrontier::retryLater(const QNetworkRequest &request, int delay) {
+
+    QHash<QUrl, UrlState>::iterator it = m_urlStates.find(request.url());
+    if (it == m_urlStates.end() || it.value() != InFlight)
+        return;
+    it.value() = Delayed;
+    m_inFlightRequests.remove(request.url());
+    m_delayedRequests.insert(m_clock.elapsed() + delay, request);
+}
+
+qint64 CrawlFrontier::msecsToNextRetry() const {
+
+    if (m_delayedRequests.isEmpty())
+        return -1;
+    return qMax<qint64>(0, m_delayedRequests.firstKey() - m_clock.elapsed());
+}
+
+void CrawlFrontier::releaseDelayed() {
+
+    // retries are sent before new requests, they have waited already
+    qint64 now = m_clock.elapsed();
+    QList<QNetworkRequest> dueRequests;
+    while (!m_delayedRequests.isEmpty() && m_delayedRequests.firstKey() <= now) {
+        QNetworkRequest request = m_delayedRequests.take(m_delayedRequests.firstKey());
+        m_urlStates.insert(request.url(), Pending);
+        dueRequests.append(request);
+    }
+    for (int a = dueRequests.count() - 1; a >= 0; a--)
+        m_requestsToSend.prepend(dueRequests.at(a));
+}
+
+CrawlFrontier::PendingRequests CrawlFrontier::pendingRequests() const {
+
+    PendingRequests pending;
+    pending.inFlight = m_inFlightRequests;
+    pending.delayed = m_delayedRequests;
+    pending.toSend = m_requestsToSend;
+    return pending;
+}
+
+QList<QNetworkRequest> CrawlFrontier::PendingRequests::toList() const {
+
+    return inFlight.values() + delayed.values() + toSend;
+}
+
+void CrawlFrontier::restore(const QList<QNetworkRequest> &pendingRequests, const VisitedUrlSet &visitedUrls) {
+
+    m_visitedUrls = visitedUrls;
+    foreach (const QNetworkRequest &request, pendingRequests)
+        enqueueIfNew(request);
+}
+
+void CrawlFrontier::pullSeeds() {
+
+    // only read as many seeds as needed, so the whole list
+    // is never held in memory
+    bool pulled = false;
+    while (m_requestsToSend.isEmpty() && m_seedSource && !m_seedSource->atEnd()) {
+        QNetworkRequest request = m_seedSource->nextRequest();
+        if (!request.url().isEmpty())
+            enqueueIfNew(request);
+        pulled = true;
+    }
+    if (pulled && m_checkpoint)
+        m_checkpoint->seedPositionChanged(m_seedSource->position(), m_seedSource->currentLine());
+}
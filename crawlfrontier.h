@@ -0,0 +1,116 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CRAWLFRONTIER_H
+#define CRAWLFRONTIER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMultiMap>
+#include <QQueue>
+#include <QUrl>
+#include <QNetworkRequest>
+
+#include "visitedurlset.h"
+
+class SeedSource;
+class CrawlCheckpoint;
+
+// keeps track of all URLs the crawler knows about: a FIFO queue of the
+// requests still to be sent, a hash table holding the state of every
+// pending or in-flight URL, and the (possibly compact) set of visited
+// URLs, so that checking whether a URL is new is O(1).
+// Requests to be retried wait in a second queue ordered by time.
+// Seeds are only pulled from the seed source when the queue runs empty.
+class CrawlFrontier
+{
+public:
+    enum UrlState {
+        Unknown,
+        Pending,
+        InFlight,
+        Delayed,
+        Visited
+    };
+
+    // for checkpoints: implicitly shared copies of the queues, cheap to take
+    // on the crawler's thread, so they can be serialized in another one;
+    // requests in flight are pending after a resume, because they have
+    // to be sent again
+    class PendingRequests {
+    public:
+        QList<QNetworkRequest> toList() const;
+        QHash<QUrl, QNetworkRequest> inFlight;
+        QMultiMap<qint64, QNetworkRequest> delayed;
+        QQueue<QNetworkRequest> toSend;
+    };
+
+    CrawlFrontier();
+
+    void setSeedSource(SeedSource *seedSource) { m_seedSource = seedSource; }
+    // every change of a URL's state is recorded in the checkpoint log
+    void setCheckpoint(CrawlCheckpoint *checkpoint) { m_checkpoint = checkpoint; }
+
+    // returns false if the URL is pending, in flight or visited already;
+    // with first, the request is sent before all others pending. The URL
+    // is normalized (see normalizedUrl()), so the URLs given to the other
+    // functions, which come from the requests handed out, are as well.
+    bool enqueueIfNew(const QNetworkRequest &request, bool first = false);
+    // moves the next pending request to the in-flight state
+    QNetworkRequest takeNext();
+    // does nothing for requests waiting for a retry
+    void markVisited(const QUrl &url);
+    // takes back a request in flight, it is pending again after delay msecs
+    void retryLater(const QNetworkRequest &request, int delay);
+    // -1 if no request is waiting for a retry
+    qint64 msecsToNextRetry() const;
+
+    UrlState state(const QUrl &url) const;
+    bool hasPending();
+    int pendingCount() const { return m_requestsToSend.count(); }
+    int inFlightCount() const { return m_inFlightRequests.count(); }
+    int delayedCount() const { return m_delayedRequests.count(); }
+    bool isIdle() const;
+
+    PendingRequests pendingRequests() const;
+    const VisitedUrlSet &visitedUrls() const { return m_visitedUrls; }
+    VisitedUrlSet &visitedUrls() { return m_visitedUrls; }
+    void restore(const QList<QNetworkRequest> &pendingRequests, const VisitedUrlSet &visitedUrls);
+
+    // "https://www.example.com", "https://www.example.com/" and
+    // "https://www.example.com/#top" are the same
+    static QUrl normalizedUrl(const QUrl &url);
+
+private:
+    void pullSeeds();
+    void releaseDelayed();
+
+    SeedSource *m_seedSource;
+    CrawlCheckpoint *m_checkpoint;
+    QHash<QUrl, UrlState> m_urlStates;
+    QQueue<QNetworkRequest> m_requestsToSend;
+    QHash<QUrl, QNetworkRequest> m_inFlightRequests;
+    QMultiMap<qint64, QNetworkRequest> m_delayedRequests; // by time they are due
+    QElapsedTimer m_clock;
+    VisitedUrlSet m_visitedUrls;
+};
+
+#endif // CRAWLFRONTIER_H
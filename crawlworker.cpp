@@ -0,0 +1,85 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "crawlworker.h"
+#include "workerchannel.h"
+#include "logging.h"
+
+#include <QCoreApplication>
+#include <QLocalSocket>
+
+CrawlWorker::CrawlWorker(QtSslCrawler *crawler, int shardIndex, QObject *parent) :
+    QObject(parent),
+    m_crawler(crawler),
+    m_shardIndex(shardIndex),
+    m_channel(0),
+    m_quitting(false)
+{
+}
+
+void CrawlWorker::start(const QString &serverName) {
+
+    QLocalSocket *socket = new QLocalSocket();
+    socket->connectToServer(serverName);
+    if (!socket->waitForConnected(30000)) {
+        qFatal("worker %d could not connect to the coordinator at %s: %s", m_shardIndex,
+               qPrintable(serverName), qPrintable(socket->errorString()));
+    }
+    m_channel = new WorkerChannel(socket, this);
+    connect(m_channel, SIGNAL(urlsReceived(QList<FoundUrl>)), m_crawler, SLOT(addRoutedUrls(QList<FoundUrl>)));
+    connect(m_channel, SIGNAL(quitReceived()), this, SLOT(quit()));
+    connect(m_channel, SIGNAL(disconnected()), this, SLOT(coordinatorGone()));
+    connect(m_crawler, SIGNAL(crawlResults(QList<CrawlResult>)),
+            this, SLOT(sendResults(QList<CrawlResult>)));
+    connect(m_crawler, SIGNAL(foreignUrlsFound(QList<FoundUrl>)), this, SLOT(sendUrls(QList<FoundUrl>)));
+    connect(m_crawler, SIGNAL(idle(int)), this, SLOT(sendIdle(int)));
+    m_channel->sendHello(m_shardIndex);
+    QMetaObject::invokeMethod(m_crawler, "start");
+}
+
+void CrawlWorker::sendResults(const QList<CrawlResult> &results) {
+
+    m_channel->sendResults(results);
+}
+
+void CrawlWorker::sendUrls(const QList<FoundUrl> &urls) {
+
+    m_channel->sendUrls(urls);
+}
+
+void CrawlWorker::sendIdle(int routedUrlsReceived) {
+
+    m_channel->sendIdle(routedUrlsReceived);
+}
+
+void CrawlWorker::quit() {
+
+    m_quitting = true;
+    QCoreApplication::quit();
+}
+
+void CrawlWorker::coordinatorGone() {
+
+    if (!m_quitting) {
+        qCWarning(lcShards, "event=coordinator_gone shard=%d", m_shardIndex);
+        QCoreApplication::quit();
+    }
+}
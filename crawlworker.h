@@ -0,0 +1,57 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef CRAWLWORKER_H
+#define CRAWLWORKER_H
+
+#include "qt-ssl-crawler.h"
+
+#include <QObject>
+
+class WorkerChannel;
+
+// the worker process side of CrawlCoordinator: connects to the
+// coordinator and passes URLs, results and idle reports between
+// it and our crawler, which must be set to the worker's shard
+class CrawlWorker : public QObject
+{
+    Q_OBJECT
+public:
+    CrawlWorker(QtSslCrawler *crawler, int shardIndex, QObject *parent = 0);
+
+public slots:
+    void start(const QString &serverName);
+
+private slots:
+    void sendResults(const QList<CrawlResult> &results);
+    void sendUrls(const QList<FoundUrl> &urls);
+    void sendIdle(int routedUrlsReceived);
+    void quit();
+    void coordinatorGone();
+
+private:
+    QtSslCrawler *m_crawler;
+    int m_shardIndex;
+    WorkerChannel *m_channel;
+    bool m_quitting;
+};
+
+#endif // CRAWLWORKER_H
@@ -0,0 +1,143 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "deadlinescheduler.h"
+
+#include <QTimer>
+
+const int DeadlineScheduler::s_tickInterval = 1000;
+// 512 seconds per turn, the default deadlines fit without extra rounds
+const int DeadlineScheduler::s_slotCount = 512;
+
+DeadlineScheduler::DeadlineScheduler(QObject *parent) :
+    QObject(parent),
+    m_tickTimer(new QTimer(this)),
+    m_wheel(s_slotCount),
+    m_currentSlot(0),
+    m_preciseTimer(new QTimer(this)),
+    m_nextSequence(0)
+{
+    m_timeouts[ConnectPhase] = 30000;
+    m_timeouts[HandshakePhase] = 30000;
+    m_timeouts[TotalPhase] = 300000;
+    m_timeouts[FallbackPhase] = 2000;
+    for (int a = 0; a < PhaseCount; a++)
+        m_expiredCounts[a] = 0;
+    m_tickTimer->setInterval(s_tickInterval);
+    connect(m_tickTimer, SIGNAL(timeout()), this, SLOT(tick()));
+    m_preciseTimer->setSingleShot(true);
+    m_preciseTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_preciseTimer, SIGNAL(timeout()), this, SLOT(preciseTick()));
+    m_clock.start();
+}
+
+void DeadlineScheduler::schedule(QObject *attempt, Phase phase) {
+
+    if (m_timeouts[phase] <= 0)
+        return;
+    Entry entry;
+    entry.attempt = attempt;
+    entry.phase = phase;
+    entry.sequence = m_nextSequence++;
+    entry.rounds = 0;
+    // replaces an older deadline of the same phase, if any
+    m_activeDeadlines.insert(DeadlineKey(attempt, phase), entry.sequence);
+    if (phase == FallbackPhase) {
+        qint64 due = m_clock.elapsed() + m_timeouts[phase];
+        m_preciseDeadlines.insert(due, entry);
+        if (m_preciseDeadlines.firstKey() == due)
+            startPreciseTimer(); // also started lazily
+        return;
+    }
+    int ticks = qMax(1, (m_timeouts[phase] + s_tickInterval - 1) / s_tickInterval);
+    entry.rounds = (ticks - 1) / s_slotCount;
+    m_wheel[(m_currentSlot + ticks) % s_slotCount].append(entry);
+    if (!m_tickTimer->isActive())
+        m_tickTimer->start(); // started lazily, so it runs in our thread
+}
+
+void DeadlineScheduler::cancel(QObject *attempt, Phase phase) {
+
+    m_activeDeadlines.remove(DeadlineKey(attempt, phase));
+}
+
+void DeadlineScheduler::cancelAll(QObject *attempt) {
+
+    for (int a = 0; a < PhaseCount; a++)
+        m_activeDeadlines.remove(DeadlineKey(attempt, a));
+}
+
+void DeadlineScheduler::tick() {
+
+    m_currentSlot = (m_currentSlot + 1) % s_slotCount;
+    QVector<Entry> entries;
+    entries.swap(m_wheel[m_currentSlot]); // expired() might schedule new deadlines
+    QVector<Entry> expiredEntries;
+    foreach (Entry entry, entries) {
+        QHash<DeadlineKey, quint32>::const_iterator it =
+                m_activeDeadlines.constFind(DeadlineKey(entry.attempt, entry.phase));
+        if (it == m_activeDeadlines.constEnd() || it.value() != entry.sequence)
+            continue; // cancelled or rescheduled
+        if (entry.rounds > 0) {
+            entry.rounds--;
+            m_wheel[m_currentSlot].append(entry);
+        } else {
+            expiredEntries.append(entry);
+        }
+    }
+    expire(expiredEntries);
+    if (m_activeDeadlines.isEmpty())
+        m_tickTimer->stop();
+}
+
+void DeadlineScheduler::preciseTick() {
+
+    qint64 now = m_clock.elapsed();
+    QVector<Entry> expiredEntries;
+    QMultiMap<qint64, Entry>::iterator it = m_preciseDeadlines.begin();
+    while (it != m_preciseDeadlines.end() && it.key() <= now) {
+        expiredEntries.append(it.value());
+        it = m_preciseDeadlines.erase(it);
+    }
+    expire(expiredEntries);
+    startPreciseTimer();
+}
+
+void DeadlineScheduler::startPreciseTimer() {
+
+    if (m_preciseDeadlines.isEmpty())
+        m_preciseTimer->stop();
+    else
+        m_preciseTimer->start(int(qMax<qint64>(0, m_preciseDeadlines.firstKey() - m_clock.elapsed())));
+}
+
+void DeadlineScheduler::expire(const QVector<Entry> &entries) {
+
+    foreach (const Entry &entry, entries) {
+        // an earlier expiration might have finished this attempt already
+        DeadlineKey key(entry.attempt, entry.phase);
+        if (m_activeDeadlines.value(key, entry.sequence + 1) != entry.sequence)
+            continue;
+        m_activeDeadlines.remove(key);
+        m_expiredCounts[entry.phase]++;
+        emit expired(entry.attempt, entry.phase);
+    }
+}
@@ -0,0 +1,104 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef DEADLINESCHEDULER_H
+#define DEADLINESCHEDULER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMultiMap>
+#include <QPair>
+#include <QVector>
+
+class QTimer;
+
+// keeps the deadlines of all requests in flight in one hashed timer wheel
+// driven by a single coarse tick, instead of one QTimer per request.
+// Every request (identified by its reply or socket) can have one deadline
+// per phase; cancelled deadlines stay in the wheel and are skipped when
+// their slot comes up. The fallback deadline is too short for the coarse
+// tick and only useful on time, so it has a precise timer of its own.
+class DeadlineScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum Phase {
+        ConnectPhase,   // until the TCP connection is established (replies: encrypted or first header)
+        HandshakePhase, // until the TLS handshake is done
+        TotalPhase,     // until the request is finished
+        FallbackPhase,  // until http:// is tried in parallel to https:// (no timeout)
+        PhaseCount
+    };
+
+    explicit DeadlineScheduler(QObject *parent = 0);
+
+    // 0 disables the phase; deadlines fire up to one tick late, except
+    // for FallbackPhase
+    void setTimeout(Phase phase, int msecs) { m_timeouts[phase] = msecs; }
+    int timeout(Phase phase) const { return m_timeouts[phase]; }
+
+    // (re)starts the deadline of attempt for phase
+    void schedule(QObject *attempt, Phase phase);
+    void cancel(QObject *attempt, Phase phase);
+    void cancelAll(QObject *attempt);
+
+    qint64 expiredCount(Phase phase) const { return m_expiredCounts[phase]; }
+    int activeCount() const { return m_activeDeadlines.count(); }
+
+signals:
+    // the deadline is removed before this is emitted
+    void expired(QObject *attempt, int phase);
+
+private slots:
+    void tick();
+    void preciseTick();
+
+private:
+    typedef QPair<QObject *, int> DeadlineKey;
+    class Entry {
+    public:
+        QObject *attempt;
+        int phase;
+        quint32 sequence;
+        int rounds; // full turns of the wheel still to wait
+    };
+
+    void expire(const QVector<Entry> &entries);
+    void startPreciseTimer();
+
+    QTimer *m_tickTimer;
+    QVector<QVector<Entry> > m_wheel;
+    int m_currentSlot;
+    // FallbackPhase, by the time they are due
+    QTimer *m_preciseTimer;
+    QMultiMap<qint64, Entry> m_preciseDeadlines;
+    QElapsedTimer m_clock;
+    quint32 m_nextSequence;
+    // the sequence number of the currently valid deadline
+    QHash<DeadlineKey, quint32> m_activeDeadlines;
+    int m_timeouts[PhaseCount];
+    qint64 m_expiredCounts[PhaseCount];
+    static const int s_tickInterval;
+    static const int s_slotCount;
+};
+
+#endif // DEADLINESCHEDULER_H
@@ -0,0 +1,168 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "domainsource.h"
+#include "sharding.h"
+#include "logging.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QUrl>
+
+#include <string.h>
+
+const int DomainSource::s_indexStride = 1024;
+
+static const quint32 indexMagic = 0x71736369; // "qsci"
+
+DomainSource::DomainSource(const QString &fileName, int from, int to) :
+    m_file(fileName),
+    m_indexFile(fileName + QStringLiteral(".index")),
+    m_data(0),
+    m_size(0),
+    m_position(0),
+    m_currentLine(1),
+    m_crawlFrom(from),
+    m_crawlTo(to),
+    m_shardIndex(0),
+    m_shardCount(1)
+{
+}
+
+DomainSource::~DomainSource() {
+
+    if (m_data)
+        m_file.unmap(reinterpret_cast<uchar *>(const_cast<char *>(m_data)));
+}
+
+bool DomainSource::open() {
+
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+    m_size = m_file.size();
+    if (m_size > 0) {
+        m_data = reinterpret_cast<const char *>(m_file.map(0, m_size));
+        if (!m_data)
+            return false;
+    }
+    if (m_crawlFrom > 1 && m_crawlTo > 0) {
+        if (!loadIndex()) {
+            buildIndex();
+            saveIndex();
+        }
+        seekToLine(m_crawlFrom);
+    }
+    return true;
+}
+
+bool DomainSource::atEnd() const {
+
+    if (m_position >= m_size)
+        return true;
+    return (m_crawlTo > 0 && m_crawlFrom > 0 && m_currentLine > m_crawlTo);
+}
+
+QNetworkRequest DomainSource::nextRequest() {
+
+    const char *lineStart = m_data + m_position;
+    const char *lineEnd = static_cast<const char *>(memchr(lineStart, '\n', m_size - m_position));
+    if (!lineEnd)
+        lineEnd = m_data + m_size;
+    m_position = lineEnd - m_data + 1;
+    m_currentLine++;
+
+    const char *comma = static_cast<const char *>(memchr(lineStart, ',', lineEnd - lineStart));
+    QByteArray domain = QByteArray(comma ? comma + 1 : lineStart,
+                                   lineEnd - (comma ? comma + 1 : lineStart)).trimmed();
+    QUrl url = QUrl::fromEncoded(domain.prepend("https://www."));
+    if (shardForHost(url.host(), m_shardCount) != m_shardIndex)
+        return QNetworkRequest();
+    QNetworkRequest request(url);
+    // setting the attribute to trace the originating URL,
+    // because we might try different URLs or get redirects
+    request.setAttribute(QNetworkRequest::User, url);
+    return request;
+}
+
+bool DomainSource::loadIndex() {
+
+    if (!m_indexFile.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream stream(&m_indexFile);
+    quint32 magic;
+    qint64 size, lastModified;
+    qint32 stride;
+    stream >> magic >> size >> lastModified >> stride >> m_lineOffsets;
+    m_indexFile.close();
+    if (stream.status() != QDataStream::Ok || magic != indexMagic || size != m_size
+        || lastModified != QFileInfo(m_file).lastModified().toMSecsSinceEpoch()
+        || stride != s_indexStride) {
+        m_lineOffsets.clear();
+        return false;
+    }
+    return true;
+}
+
+void DomainSource::buildIndex() {
+
+    m_lineOffsets.clear();
+    qint64 position = 0;
+    int line = 1;
+    while (position < m_size) {
+        if ((line - 1) % s_indexStride == 0)
+            m_lineOffsets.append(position);
+        const char *lineEnd = static_cast<const char *>(memchr(m_data + position, '\n', m_size - position));
+        if (!lineEnd)
+            break;
+        position = lineEnd - m_data + 1;
+        line++;
+    }
+}
+
+void DomainSource::saveIndex() {
+
+    if (!m_indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCWarning(lcStorage, "event=index_write_failed file=%s", qUtf8Printable(m_indexFile.fileName()));
+        return;
+    }
+    QDataStream stream(&m_indexFile);
+    stream << indexMagic << m_size << QFileInfo(m_file).lastModified().toMSecsSinceEpoch()
+           << qint32(s_indexStride) << m_lineOffsets;
+    m_indexFile.close();
+}
+
+void DomainSource::seekToLine(int line) {
+
+    int indexEntry = (line - 1) / s_indexStride;
+    if (indexEntry >= m_lineOffsets.count()) {
+        m_position = m_size; // the file does not have that many lines
+        return;
+    }
+    m_position = m_lineOffsets.at(indexEntry);
+    m_currentLine = indexEntry * s_indexStride + 1;
+    // skip the remaining lines (less than s_indexStride)
+    while (m_currentLine < line && m_position < m_size) {
+        const char *lineEnd = static_cast<const char *>(memchr(m_data + m_position, '\n', m_size - m_position));
+        m_position = lineEnd ? lineEnd - m_data + 1 : m_size;
+        m_currentLine++;
+    }
+}
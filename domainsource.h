@@ -0,0 +1,72 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef DOMAINSOURCE_H
+#define DOMAINSOURCE_H
+
+#include <QFile>
+#include <QVector>
+#include <QNetworkRequest>
+
+#include "seedsource.h"
+
+// reads the seed domains from a top-1m.csv style file ("rank,domain" per line)
+// lazily: the file is memory-mapped and a request is only created when the
+// frontier asks for one. An index with the offset of every s_indexStride-th
+// line is kept next to the file, so we can seek directly to line 'from'.
+class DomainSource : public SeedSource
+{
+public:
+    DomainSource(const QString &fileName, int from = 0, int to = 0);
+    ~DomainSource();
+
+    // only hand out domains whose host belongs to the given shard
+    void setShard(int index, int count) { m_shardIndex = index; m_shardCount = count; }
+    bool open();
+    bool atEnd() const;
+    // returns an empty request for lines belonging to another shard
+    QNetworkRequest nextRequest();
+    int currentLine() const { return m_currentLine; }
+    qint64 position() const { return m_position; }
+    // continue reading at a position saved before, see CrawlCheckpoint
+    void restorePosition(qint64 position, int line) { m_position = position; m_currentLine = line; }
+
+private:
+    bool loadIndex();
+    void buildIndex();
+    void saveIndex();
+    void seekToLine(int line);
+
+    QFile m_file;
+    QFile m_indexFile;
+    const char *m_data;
+    qint64 m_size;
+    qint64 m_position;
+    int m_currentLine; // number of the line m_position points to, starting at 1
+    int m_crawlFrom;
+    int m_crawlTo;
+    int m_shardIndex;
+    int m_shardCount;
+    QVector<qint64> m_lineOffsets;
+    static const int s_indexStride;
+};
+
+#endif // DOMAINSOURCE_H
@@ -0,0 +1,147 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "hostresolver.h"
+#include "logging.h"
+#include "metrics.h"
+
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QUrl>
+
+// QHostInfo keeps answers for 60 seconds; we let the requests for a
+// host through without a lookup a bit shorter than that, so their
+// connections still find the addresses in its cache
+static const int positiveCacheTime = 50;
+
+HostResolver::HostResolver(QObject *parent) :
+    QObject(parent),
+    m_maxConcurrentLookups(50),
+    m_negativeCacheTime(900),
+    m_runningLookups(0),
+    m_waitingCount(0),
+    m_lastExpiryCheck(0),
+    m_lookupCount(0),
+    m_cacheHitCount(0),
+    m_notFoundCount(0)
+{
+    m_clock.start();
+}
+
+void HostResolver::resolve(const QNetworkRequest &request) {
+
+    QString host = request.url().host();
+    if (QHostAddress(host).protocol() != QAbstractSocket::UnknownNetworkLayerProtocol) {
+        m_resolvedRequests.enqueue(request); // no need to resolve IP addresses
+        return;
+    }
+
+    QHash<QString, CacheEntry>::const_iterator it = m_cache.constFind(host);
+    if (it != m_cache.constEnd() && it.value().expires > m_clock.elapsed()) {
+        m_cacheHitCount++;
+        CrawlMetrics::instance().dnsCacheHits->increment();
+        if (it.value().exists) {
+            m_resolvedRequests.enqueue(request);
+        } else {
+            m_notFoundCount++;
+            CrawlMetrics::instance().dnsNotFound->increment();
+            emit hostNotFound(request);
+        }
+        return;
+    }
+
+    QList<QNetworkRequest> &waiting = m_waitingRequests[host];
+    if (waiting.isEmpty())
+        m_hostsToLookUp.enqueue(host); // otherwise the lookup is running already
+    waiting.append(request);
+    m_waitingCount++;
+    startLookups();
+}
+
+void HostResolver::startLookups() {
+
+    while (m_runningLookups < m_maxConcurrentLookups && !m_hostsToLookUp.isEmpty()) {
+        RunningLookup lookup;
+        lookup.host = m_hostsToLookUp.dequeue();
+        lookup.started = m_clock.elapsed();
+        // the result always arrives through the event loop, also from the cache
+        int id = QHostInfo::lookupHost(lookup.host, this, SLOT(lookupFinished(QHostInfo)));
+        m_runningLookupsById.insert(id, lookup);
+        CrawlMetrics::instance().dnsLookups->increment();
+        m_runningLookups++;
+        m_lookupCount++;
+    }
+}
+
+void HostResolver::lookupFinished(const QHostInfo &hostInfo) {
+
+    RunningLookup lookup = m_runningLookupsById.take(hostInfo.lookupId());
+    QString host = lookup.host;
+    QList<QNetworkRequest> waiting = m_waitingRequests.take(host);
+    m_waitingCount -= waiting.count();
+    m_runningLookups--;
+    CrawlMetrics::instance().dnsTime->observe(m_clock.elapsed() - lookup.started);
+
+    if (hostInfo.error() == QHostInfo::HostNotFound) {
+        // NXDOMAIN or no address at all, there is no point in connecting to this host
+        CacheEntry entry;
+        entry.expires = m_clock.elapsed() + m_negativeCacheTime * 1000;
+        m_cache.insert(host, entry);
+        qCDebug(lcDns, "event=host_not_found host=%s requests=%d", qUtf8Printable(host), waiting.count());
+        m_notFoundCount += waiting.count();
+        CrawlMetrics::instance().dnsNotFound->increment(waiting.count());
+        foreach (const QNetworkRequest &request, waiting)
+            emit hostNotFound(request);
+    } else {
+        if (hostInfo.error() == QHostInfo::NoError) {
+            CacheEntry entry;
+            entry.exists = true;
+            entry.expires = m_clock.elapsed() + positiveCacheTime * 1000LL;
+            m_cache.insert(host, entry);
+        } else {
+            // timeouts, server failures etc.: not cached, let the
+            // connection attempt decide
+            qCDebug(lcDns, "event=lookup_failed host=%s error=\"%s\"",
+                    qUtf8Printable(host), qUtf8Printable(hostInfo.errorString()));
+        }
+        foreach (const QNetworkRequest &request, waiting)
+            m_resolvedRequests.enqueue(request);
+    }
+    removeExpiredEntries();
+    startLookups();
+    emit requestsResolved();
+}
+
+void HostResolver::removeExpiredEntries() {
+
+    // at most once a minute, to keep the cache from growing forever
+    qint64 now = m_clock.elapsed();
+    if (now - m_lastExpiryCheck < 60000)
+        return;
+    m_lastExpiryCheck = now;
+    QHash<QString, CacheEntry>::iterator it = m_cache.begin();
+    while (it != m_cache.end()) {
+        if (it.value().expires <= now)
+            it = m_cache.erase(it);
+        else
+            ++it;
+    }
+}
@@ -0,0 +1,100 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef HOSTRESOLVER_H
+#define HOSTRESOLVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QQueue>
+#include <QElapsedTimer>
+#include <QNetworkRequest>
+
+class QHostInfo;
+
+// resolves the hosts of requests before they get a connection slot, so
+// DNS latency does not count against the slot and requests to hosts that
+// do not exist (NXDOMAIN) are dropped without ever being sent.
+// Lookups go through QHostInfo like those of QNetworkAccessManager and
+// QSslSocket (system resolver, /etc/hosts), so the connection finds the
+// addresses in QHostInfo's cache and does not query again. Hosts that
+// do not exist are remembered for a configurable time.
+class HostResolver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HostResolver(QObject *parent = 0);
+
+    void setMaxConcurrentLookups(int lookups) { m_maxConcurrentLookups = lookups; }
+    void setNegativeCacheTime(int seconds) { m_negativeCacheTime = seconds; }
+
+    void resolve(const QNetworkRequest &request);
+    // requests waiting for their lookup or to be taken
+    int queuedCount() const { return m_waitingCount + m_resolvedRequests.count(); }
+    bool hasResolved() const { return !m_resolvedRequests.isEmpty(); }
+    QNetworkRequest takeResolved() { return m_resolvedRequests.dequeue(); }
+
+    qint64 lookupCount() const { return m_lookupCount; }
+    qint64 cacheHitCount() const { return m_cacheHitCount; }
+    qint64 notFoundCount() const { return m_notFoundCount; }
+
+signals:
+    void requestsResolved();
+    void hostNotFound(const QNetworkRequest &request);
+
+private slots:
+    void lookupFinished(const QHostInfo &hostInfo);
+
+private:
+    class CacheEntry {
+    public:
+        CacheEntry() : exists(false), expires(0) { }
+        bool exists;
+        qint64 expires; // msecs on m_clock
+    };
+
+    void startLookups();
+    void removeExpiredEntries();
+
+    int m_maxConcurrentLookups;
+    int m_negativeCacheTime;
+    int m_runningLookups;
+    int m_waitingCount;
+    QHash<QString, CacheEntry> m_cache;
+    // requests waiting for the lookup of their host
+    QHash<QString, QList<QNetworkRequest> > m_waitingRequests;
+    QQueue<QString> m_hostsToLookUp;
+    class RunningLookup {
+    public:
+        QString host;
+        qint64 started; // msecs on m_clock
+    };
+    QHash<int, RunningLookup> m_runningLookupsById;
+    QQueue<QNetworkRequest> m_resolvedRequests;
+    QElapsedTimer m_clock;
+    qint64 m_lastExpiryCheck;
+    qint64 m_lookupCount;
+    qint64 m_cacheHitCount;
+    qint64 m_notFoundCount;
+};
+
+#endif // HOSTRESOLVER_H
@@ -0,0 +1,41 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "logging.h"
+
+Q_LOGGING_CATEGORY(lcCrawler, "qtsslcrawl.crawler", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcDns, "qtsslcrawl.dns", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcShards, "qtsslcrawl.shards", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcStorage, "qtsslcrawl.storage", QtWarningMsg)
+Q_LOGGING_CATEGORY(lcMetrics, "qtsslcrawl.metrics", QtWarningMsg)
+
+bool setLogLevel(const QString &level) {
+
+    if (level == QLatin1String("debug"))
+        QLoggingCategory::setFilterRules(QStringLiteral("qtsslcrawl.*.debug=true"));
+    else if (level == QLatin1String("warning"))
+        QLoggingCategory::setFilterRules(QString());
+    else if (level == QLatin1String("critical"))
+        QLoggingCategory::setFilterRules(QStringLiteral("qtsslcrawl.*.warning=false"));
+    else
+        return false;
+    return true;
+}
@@ -0,0 +1,39 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <QLoggingCategory>
+
+// messages are "event=<name> key=value ...", so they can be grepped
+// and parsed. Debug messages are disabled by default (see setLogLevel())
+// and compiled out in release builds (QT_NO_DEBUG_OUTPUT).
+Q_DECLARE_LOGGING_CATEGORY(lcCrawler)    // requests, replies and results
+Q_DECLARE_LOGGING_CATEGORY(lcDns)        // HostResolver
+Q_DECLARE_LOGGING_CATEGORY(lcShards)     // threads and worker processes
+Q_DECLARE_LOGGING_CATEGORY(lcStorage)    // checkpoints, index and result files
+Q_DECLARE_LOGGING_CATEGORY(lcMetrics)
+
+// "debug", "warning" or "critical"; returns false for anything else
+bool setLogLevel(const QString &level);
+
+#endif // LOGGING_H
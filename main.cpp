@@ -20,21 +20,298 @@
 *************************************************************************************/
 
 #include <QtCore/QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
 #include "qt-ssl-crawler.h"
+#include "crawlerpool.h"
+#include "crawlcoordinator.h"
+#include "crawlworker.h"
 #include "resultparser.h"
+#include "recrawlplanner.h"
+#include "logging.h"
+#include "metricsexporter.h"
 
 int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
+    qSetMessagePattern(QStringLiteral("level=%{type} category=%{category} %{message}"));
+
+    QCommandLineParser commandLineParser;
+    commandLineParser.setApplicationDescription(QStringLiteral("Crawls SSL certificates of the sites in top-1m.csv"));
+    commandLineParser.addHelpOption();
+    commandLineParser.addPositionalArgument(QStringLiteral("from"), QStringLiteral("first line of top-1m.csv to crawl"));
+    commandLineParser.addPositionalArgument(QStringLiteral("to"), QStringLiteral("last line of top-1m.csv to crawl"));
+    QCommandLineOption threadsOption(QStringLiteral("threads"),
+            QStringLiteral("Crawl with <n> threads, each with its own network access manager."),
+            QStringLiteral("n"), QStringLiteral("1"));
+    commandLineParser.addOption(threadsOption);
+    QCommandLineOption workersOption(QStringLiteral("workers"),
+            QStringLiteral("Crawl with <n> worker processes, each owning a part of the hosts; "
+                           "the results are merged by this process."),
+            QStringLiteral("n"), QStringLiteral("1"));
+    commandLineParser.addOption(workersOption);
+    QCommandLineOption coordinatorOption(QStringLiteral("coordinator"),
+            QStringLiteral("Internal: run as worker process of the coordinator at local socket <name>."),
+            QStringLiteral("name"));
+    commandLineParser.addOption(coordinatorOption);
+    QCommandLineOption workerShardOption(QStringLiteral("worker-shard"),
+            QStringLiteral("Internal: the shard of this worker process."), QStringLiteral("i"));
+    commandLineParser.addOption(workerShardOption);
+    QCommandLineOption workerShardsOption(QStringLiteral("worker-shards"),
+            QStringLiteral("Internal: the number of worker processes."), QStringLiteral("n"));
+    commandLineParser.addOption(workerShardsOption);
+    QCommandLineOption minConcurrencyOption(QStringLiteral("min-concurrency"),
+            QStringLiteral("Never have less than <n> requests in flight (per thread)."),
+            QStringLiteral("n"), QStringLiteral("20"));
+    commandLineParser.addOption(minConcurrencyOption);
+    QCommandLineOption maxConcurrencyOption(QStringLiteral("max-concurrency"),
+            QStringLiteral("Never have more than <n> requests in flight (per thread)."),
+            QStringLiteral("n"), QStringLiteral("1000"));
+    commandLineParser.addOption(maxConcurrencyOption);
+    QCommandLineOption probeOption(QStringLiteral("probe"),
+            QStringLiteral("Only do the TLS handshake for https:// URLs instead of fetching them "
+                           "(links on https:// pages will not be followed)."));
+    commandLineParser.addOption(probeOption);
+    QCommandLineOption maxBodySizeOption(QStringLiteral("max-body-size"),
+            QStringLiteral("Abort replies after <bytes> bytes of body (0: no limit)."),
+            QStringLiteral("bytes"), QStringLiteral("4194304"));
+    commandLineParser.addOption(maxBodySizeOption);
+    QCommandLineOption resolverConcurrencyOption(QStringLiteral("resolver-concurrency"),
+            QStringLiteral("Resolve hosts ahead of sending with up to <n> DNS lookups at a time "
+                           "(per thread, 0: let each connection resolve its host)."),
+            QStringLiteral("n"), QStringLiteral("50"));
+    commandLineParser.addOption(resolverConcurrencyOption);
+    QCommandLineOption negativeDnsTtlOption(QStringLiteral("negative-dns-ttl"),
+            QStringLiteral("Remember hosts that do not exist for <seconds>."),
+            QStringLiteral("seconds"), QStringLiteral("900"));
+    commandLineParser.addOption(negativeDnsTtlOption);
+    QCommandLineOption connectTimeoutOption(QStringLiteral("connect-timeout"),
+            QStringLiteral("Give up connecting after <seconds> (0: no limit); for fetched pages until "
+                           "the TLS handshake is done or the first http:// header arrived."),
+            QStringLiteral("seconds"), QStringLiteral("30"));
+    commandLineParser.addOption(connectTimeoutOption);
+    QCommandLineOption handshakeTimeoutOption(QStringLiteral("handshake-timeout"),
+            QStringLiteral("Give up the TLS handshake after <seconds> (0: no limit)."),
+            QStringLiteral("seconds"), QStringLiteral("30"));
+    commandLineParser.addOption(handshakeTimeoutOption);
+    QCommandLineOption totalTimeoutOption(QStringLiteral("total-timeout"),
+            QStringLiteral("Give up a request after <seconds> in total (0: no limit)."),
+            QStringLiteral("seconds"), QStringLiteral("300"));
+    commandLineParser.addOption(totalTimeoutOption);
+    QCommandLineOption retriesOption(QStringLiteral("retries"),
+            QStringLiteral("Retry requests failing with a temporary error (e.g. a timeout) up to <n> times."),
+            QStringLiteral("n"), QStringLiteral("1"));
+    commandLineParser.addOption(retriesOption);
+    QCommandLineOption retryDelayOption(QStringLiteral("retry-delay"),
+            QStringLiteral("Wait <seconds> before the first retry, twice as long before each further one."),
+            QStringLiteral("seconds"), QStringLiteral("5"));
+    commandLineParser.addOption(retryDelayOption);
+    QCommandLineOption fallbackDelayOption(QStringLiteral("fallback-delay"),
+            QStringLiteral("Try http:// in parallel if https:// has not connected after <msecs> "
+                           "(0: only after https:// failed)."),
+            QStringLiteral("msecs"), QStringLiteral("2000"));
+    commandLineParser.addOption(fallbackDelayOption);
+    QCommandLineOption recrawlOption(QStringLiteral("recrawl"),
+            QStringLiteral("Instead of top-1m.csv, check the sites in the binary results <file> again "
+                           "and only output the chains that changed (implies --probe). Can be given more "
+                           "than once, oldest file first, to take the changes of earlier re-crawls into account."),
+            QStringLiteral("file"));
+    commandLineParser.addOption(recrawlOption);
+    QCommandLineOption recrawlTopOption(QStringLiteral("recrawl-top"),
+            QStringLiteral("Only check the <n> sites most likely to have changed (0: all)."),
+            QStringLiteral("n"), QStringLiteral("0"));
+    commandLineParser.addOption(recrawlTopOption);
+    QCommandLineOption recrawlBudgetOption(QStringLiteral("recrawl-budget"),
+            QStringLiteral("Stop starting new checks after <seconds> (0: no limit)."),
+            QStringLiteral("seconds"), QStringLiteral("0"));
+    commandLineParser.addOption(recrawlBudgetOption);
+    QCommandLineOption outputOption(QStringLiteral("output"),
+            QStringLiteral("Write the results to <file> instead of stdout."), QStringLiteral("file"));
+    commandLineParser.addOption(outputOption);
+    QCommandLineOption outputFormatOption(QStringLiteral("output-format"),
+            QStringLiteral("Write results as 'csv' or 'binary'."), QStringLiteral("format"), QStringLiteral("csv"));
+    commandLineParser.addOption(outputFormatOption);
+    QCommandLineOption streamOption(QStringLiteral("stream"),
+            QStringLiteral("Write every result as soon as it is found instead of collecting them until "
+                           "the end (a site once when it is first found, then one line per further "
+                           "linking URL with empty certificate columns)."));
+    commandLineParser.addOption(streamOption);
+    QCommandLineOption aggregateOption(QStringLiteral("aggregate"),
+            QStringLiteral("Only write a summary: sites per root certificate organization and per country, "
+                           "and the most linked sites, estimated in fixed memory."));
+    commandLineParser.addOption(aggregateOption);
+    QCommandLineOption aggregateIntervalOption(QStringLiteral("aggregate-interval"),
+            QStringLiteral("With --aggregate, log the summary every <seconds> while crawling."),
+            QStringLiteral("seconds"));
+    commandLineParser.addOption(aggregateIntervalOption);
+    QCommandLineOption checkpointOption(QStringLiteral("checkpoint"),
+            QStringLiteral("Save the crawl state periodically to files starting with <name>."),
+            QStringLiteral("name"));
+    commandLineParser.addOption(checkpointOption);
+    QCommandLineOption resumeOption(QStringLiteral("resume"),
+            QStringLiteral("Resume the crawl saved with --checkpoint (default name: qt-ssl-crawl), "
+                           "use the same 'from', 'to' and --threads as before."));
+    commandLineParser.addOption(resumeOption);
+    QCommandLineOption visitedSetOption(QStringLiteral("visited-set"),
+            QStringLiteral("How to store visited URLs: 'exact', 'fingerprint' (64-bit hashes) or "
+                           "'bloom' (Bloom filter, might skip some new URLs)."),
+            QStringLiteral("mode"), QStringLiteral("exact"));
+    commandLineParser.addOption(visitedSetOption);
+    QCommandLineOption bloomCapacityOption(QStringLiteral("bloom-capacity"),
+            QStringLiteral("Expected number of visited URLs for --visited-set bloom."),
+            QStringLiteral("n"), QStringLiteral("10000000"));
+    commandLineParser.addOption(bloomCapacityOption);
+    QCommandLineOption bloomFalsePositiveRateOption(QStringLiteral("bloom-false-positive-rate"),
+            QStringLiteral("False positive rate for --visited-set bloom."),
+            QStringLiteral("rate"), QStringLiteral("0.001"));
+    commandLineParser.addOption(bloomFalsePositiveRateOption);
+    QCommandLineOption logLevelOption(QStringLiteral("log-level"),
+            QStringLiteral("Log 'debug', 'warning' or 'critical' messages and above "
+                           "(debug messages are not compiled into release builds)."),
+            QStringLiteral("level"), QStringLiteral("warning"));
+    commandLineParser.addOption(logLevelOption);
+    QCommandLineOption metricsPortOption(QStringLiteral("metrics-port"),
+            QStringLiteral("Serve the metrics in Prometheus text format on localhost:<port>. With --workers, "
+                           "this only has the results, worker i serves the crawl metrics on <port> + 1 + i."),
+            QStringLiteral("port"));
+    commandLineParser.addOption(metricsPortOption);
+    QCommandLineOption metricsIntervalOption(QStringLiteral("metrics-interval"),
+            QStringLiteral("Log the metrics every <seconds>."), QStringLiteral("seconds"));
+    commandLineParser.addOption(metricsIntervalOption);
+    commandLineParser.process(app);
+    if (!setLogLevel(commandLineParser.value(logLevelOption)))
+        commandLineParser.showHelp(1);
 
     int from = 0, to = 0;
-    if (app.arguments().count() >= 3) {
-        from = app.arguments().at(1).toInt();
-        to = app.arguments().at(2).toInt();
+    if (commandLineParser.positionalArguments().count() >= 2) {
+        from = commandLineParser.positionalArguments().at(0).toInt();
+        to = commandLineParser.positionalArguments().at(1).toInt();
+    }
+    int threadCount = qMax(1, commandLineParser.value(threadsOption).toInt());
+    int workerCount = qMax(1, commandLineParser.value(workersOption).toInt());
+    bool isWorker = commandLineParser.isSet(coordinatorOption);
+    int workerShard = commandLineParser.value(workerShardOption).toInt();
+    if (isWorker && threadCount > 1) {
+        // the threads would shard by the same hash as the processes
+        qCWarning(lcShards, "event=option_ignored option=threads reason=worker_process");
+        threadCount = 1;
+    }
+    bool isCoordinator = (workerCount > 1 && !isWorker);
+    bool probeMode = commandLineParser.isSet(probeOption) || commandLineParser.isSet(recrawlOption);
+    int minConcurrency = commandLineParser.value(minConcurrencyOption).toInt();
+    int maxConcurrency = commandLineParser.value(maxConcurrencyOption).toInt();
+    qint64 maxBodySize = commandLineParser.value(maxBodySizeOption).toLongLong();
+    int resolverConcurrency = commandLineParser.value(resolverConcurrencyOption).toInt();
+    int negativeDnsTtl = commandLineParser.value(negativeDnsTtlOption).toInt();
+    int connectTimeout = commandLineParser.value(connectTimeoutOption).toInt() * 1000;
+    int handshakeTimeout = commandLineParser.value(handshakeTimeoutOption).toInt() * 1000;
+    int totalTimeout = commandLineParser.value(totalTimeoutOption).toInt() * 1000;
+    int maxRetries = commandLineParser.value(retriesOption).toInt();
+    int retryDelay = commandLineParser.value(retryDelayOption).toInt() * 1000;
+    int fallbackDelay = commandLineParser.value(fallbackDelayOption).toInt();
+    bool resume = commandLineParser.isSet(resumeOption);
+    QString checkpointName = commandLineParser.value(checkpointOption);
+    if (resume && checkpointName.isEmpty())
+        checkpointName = QStringLiteral("qt-ssl-crawl");
+    VisitedUrlSet::Mode visitedSetMode = VisitedUrlSet::ExactMode;
+    if (commandLineParser.value(visitedSetOption) == QLatin1String("fingerprint"))
+        visitedSetMode = VisitedUrlSet::FingerprintMode;
+    else if (commandLineParser.value(visitedSetOption) == QLatin1String("bloom"))
+        visitedSetMode = VisitedUrlSet::BloomFilterMode;
+    qint64 bloomCapacity = qMax<qint64>(1, commandLineParser.value(bloomCapacityOption).toLongLong());
+    double bloomFalsePositiveRate = commandLineParser.value(bloomFalsePositiveRateOption).toDouble();
+
+    // metrics are per process: the crawl itself happens in the workers of a
+    // coordinator, so each of them serves its own on the ports after ours
+    MetricsExporter metricsExporter;
+    if (commandLineParser.isSet(metricsPortOption)) {
+        int metricsPort = commandLineParser.value(metricsPortOption).toInt();
+        if (isWorker)
+            metricsPort += 1 + workerShard;
+        if (!metricsExporter.listen(metricsPort))
+            return 1;
+        if (isCoordinator) {
+            qCWarning(lcMetrics, "event=metrics_per_worker port=%d worker_ports=%d-%d",
+                      metricsPort, metricsPort + 1, metricsPort + workerCount);
+        }
+    }
+    if (commandLineParser.value(metricsIntervalOption).toInt() > 0)
+        metricsExporter.startDumping(commandLineParser.value(metricsIntervalOption).toInt() * 1000);
+
+    // the workers of a coordinator load the plan themselves
+    QSharedPointer<RecrawlPlan> recrawlPlan;
+    qint64 recrawlBudget = commandLineParser.value(recrawlBudgetOption).toLongLong() * 1000;
+    if (commandLineParser.isSet(recrawlOption) && !isCoordinator) {
+        recrawlPlan = QSharedPointer<RecrawlPlan>(new RecrawlPlan);
+        if (!recrawlPlan->load(commandLineParser.values(recrawlOption)))
+            return 1;
+        recrawlPlan->prioritize(QDateTime::currentMSecsSinceEpoch(),
+                                commandLineParser.value(recrawlTopOption).toInt());
+    }
+
+    QObject *crawler;
+    if (isCoordinator) {
+        // the workers get all our arguments, except for the number of workers
+        QStringList workerArguments;
+        QStringList arguments = app.arguments().mid(1);
+        for (int a = 0; a < arguments.count(); a++) {
+            if (arguments.at(a) == QLatin1String("--workers") || arguments.at(a) == QLatin1String("-workers"))
+                a++; // skip the value, too
+            else if (!arguments.at(a).startsWith(QLatin1String("--workers=")))
+                workerArguments.append(arguments.at(a));
+        }
+        crawler = new CrawlCoordinator(workerCount, workerArguments, &app);
+    } else if (threadCount > 1) {
+        CrawlerPool *pool = new CrawlerPool(threadCount, &app, from, to);
+        pool->setConcurrencyLimits(minConcurrency, maxConcurrency);
+        pool->setProbeMode(probeMode);
+        pool->setMaxBodySize(maxBodySize);
+        pool->setHostResolution(resolverConcurrency, negativeDnsTtl);
+        pool->setTimeouts(connectTimeout, handshakeTimeout, totalTimeout);
+        pool->setRetryPolicy(maxRetries, retryDelay);
+        pool->setFallbackDelay(fallbackDelay);
+        if (recrawlPlan)
+            pool->setRecrawlPlan(recrawlPlan, recrawlBudget);
+        pool->setVisitedUrlSetMode(visitedSetMode, bloomCapacity, bloomFalsePositiveRate);
+        if (!checkpointName.isEmpty())
+            pool->setCheckpoint(checkpointName, resume);
+        crawler = pool;
+    } else {
+        QtSslCrawler *singleCrawler = new QtSslCrawler(&app, from, to);
+        singleCrawler->setConcurrencyLimits(minConcurrency, maxConcurrency);
+        singleCrawler->setProbeMode(probeMode);
+        singleCrawler->setMaxBodySize(maxBodySize);
+        singleCrawler->setHostResolution(resolverConcurrency, negativeDnsTtl);
+        singleCrawler->setTimeouts(connectTimeout, handshakeTimeout, totalTimeout);
+        singleCrawler->setRetryPolicy(maxRetries, retryDelay);
+        singleCrawler->setFallbackDelay(fallbackDelay);
+        if (recrawlPlan)
+            singleCrawler->setRecrawlPlan(recrawlPlan, recrawlBudget);
+        singleCrawler->setVisitedUrlSetMode(visitedSetMode, bloomCapacity, bloomFalsePositiveRate);
+        if (isWorker) {
+            // a worker only talks to the coordinator, which writes the results
+            singleCrawler->setShard(workerShard, commandLineParser.value(workerShardsOption).toInt());
+            if (!checkpointName.isEmpty())
+                singleCrawler->setCheckpoint(checkpointName + QStringLiteral(".worker") + QString::number(workerShard), resume);
+            CrawlWorker *worker = new CrawlWorker(singleCrawler, workerShard, &app);
+            worker->start(commandLineParser.value(coordinatorOption));
+            return app.exec();
+        }
+        if (!checkpointName.isEmpty())
+            singleCrawler->setCheckpoint(checkpointName, resume);
+        crawler = singleCrawler;
     }
-    QtSslCrawler crawler(0, from, to);
-    ResultParser parser(&crawler);
+    ResultWriter::Format outputFormat = ResultWriter::CsvFormat;
+    if (commandLineParser.value(outputFormatOption) == QLatin1String("binary"))
+        outputFormat = ResultWriter::BinaryFormat;
+    ResultParser::Mode parserMode = ResultParser::CollectMode;
+    if (commandLineParser.isSet(aggregateOption))
+        parserMode = ResultParser::AggregateMode;
+    else if (commandLineParser.isSet(streamOption))
+        parserMode = ResultParser::StreamMode;
+    ResultParser parser(crawler, commandLineParser.value(outputOption), outputFormat, parserMode);
+    parser.setSummaryInterval(commandLineParser.value(aggregateIntervalOption).toInt() * 1000);
     QObject::connect(&parser, SIGNAL(parsingDone()), &app, SLOT(quit()));
-    crawler.start();
+    QMetaObject::invokeMethod(crawler, "start");
     return app.exec();
 }
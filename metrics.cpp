@@ -0,0 +1,182 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "metrics.h"
+
+#include <QMutexLocker>
+
+const qint64 MetricHistogram::s_bucketBounds[MetricHistogram::s_bucketCount] = {
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000, 300000
+};
+
+MetricHistogram::MetricHistogram() :
+    m_sum(0),
+    m_count(0)
+{
+    for (int a = 0; a <= s_bucketCount; a++)
+        m_buckets[a].store(0);
+}
+
+void MetricHistogram::observe(qint64 msecs) {
+
+    int index = 0;
+    while (index < s_bucketCount && msecs > s_bucketBounds[index])
+        index++;
+    m_buckets[index].fetchAndAddRelaxed(1);
+    m_sum.fetchAndAddRelaxed(msecs);
+    m_count.fetchAndAddRelaxed(1);
+}
+
+Metrics *Metrics::instance() {
+
+    static Metrics metrics;
+    return &metrics;
+}
+
+void *Metrics::find(const char *name, Type type) const {
+
+    foreach (const Entry &entry, m_entries) {
+        if (entry.name == name) {
+            if (entry.type != type)
+                qFatal("metric %s registered with another type", name);
+            return entry.metric;
+        }
+    }
+    return 0;
+}
+
+MetricCounter *Metrics::counter(const char *name, const char *help) {
+
+    QMutexLocker locker(&m_mutex);
+    if (void *metric = find(name, CounterType))
+        return static_cast<MetricCounter *>(metric);
+    Entry entry = { name, help, CounterType, new MetricCounter };
+    m_entries.append(entry);
+    return static_cast<MetricCounter *>(entry.metric);
+}
+
+MetricGauge *Metrics::gauge(const char *name, const char *help) {
+
+    QMutexLocker locker(&m_mutex);
+    if (void *metric = find(name, GaugeType))
+        return static_cast<MetricGauge *>(metric);
+    Entry entry = { name, help, GaugeType, new MetricGauge };
+    m_entries.append(entry);
+    return static_cast<MetricGauge *>(entry.metric);
+}
+
+MetricHistogram *Metrics::histogram(const char *name, const char *help) {
+
+    QMutexLocker locker(&m_mutex);
+    if (void *metric = find(name, HistogramType))
+        return static_cast<MetricHistogram *>(metric);
+    Entry entry = { name, help, HistogramType, new MetricHistogram };
+    m_entries.append(entry);
+    return static_cast<MetricHistogram *>(entry.metric);
+}
+
+QByteArray Metrics::format() const {
+
+    QMutexLocker locker(&m_mutex);
+    QByteArray text;
+    foreach (const Entry &entry, m_entries) {
+        text += "# HELP " + entry.name + ' ' + entry.help + '\n';
+        switch (entry.type) {
+        case CounterType:
+            text += "# TYPE " + entry.name + " counter\n" + entry.name + ' '
+                    + QByteArray::number(static_cast<MetricCounter *>(entry.metric)->value()) + '\n';
+            break;
+        case GaugeType:
+            text += "# TYPE " + entry.name + " gauge\n" + entry.name + ' '
+                    + QByteArray::number(static_cast<MetricGauge *>(entry.metric)->value()) + '\n';
+            break;
+        case HistogramType: {
+            MetricHistogram *histogram = static_cast<MetricHistogram *>(entry.metric);
+            text += "# TYPE " + entry.name + " histogram\n";
+            qint64 cumulative = 0;
+            for (int a = 0; a <= MetricHistogram::s_bucketCount; a++) {
+                cumulative += histogram->bucket(a);
+                QByteArray bound = (a < MetricHistogram::s_bucketCount)
+                        ? QByteArray::number(MetricHistogram::s_bucketBounds[a]) : QByteArray("+Inf");
+                text += entry.name + "_bucket{le=\"" + bound + "\"} " + QByteArray::number(cumulative) + '\n';
+            }
+            text += entry.name + "_sum " + QByteArray::number(histogram->sum()) + '\n'
+                    + entry.name + "_count " + QByteArray::number(histogram->count()) + '\n';
+            break;
+        }
+        }
+    }
+    return text;
+}
+
+const CrawlMetrics &CrawlMetrics::instance() {
+
+    static CrawlMetrics metrics;
+    return metrics;
+}
+
+CrawlMetrics::CrawlMetrics() {
+
+    Metrics *m = Metrics::instance();
+    requestsSent = m->counter("qtsslcrawl_requests_sent_total", "HTTP(S) requests sent");
+    probesSent = m->counter("qtsslcrawl_probes_sent_total", "TLS handshakes started in probe mode");
+    requestErrors = m->counter("qtsslcrawl_request_errors_total", "requests and probes failed with an error");
+    results = m->counter("qtsslcrawl_results_total", "certificate chains found");
+    hostCacheHits = m->counter("qtsslcrawl_host_cache_hits_total", "chains taken from the host:port cache");
+    urlsFound = m->counter("qtsslcrawl_urls_found_total", "https URLs found in bodies");
+    bodyBytes = m->counter("qtsslcrawl_body_bytes_total", "body bytes scanned for links");
+    connectTimeouts = m->counter("qtsslcrawl_connect_timeouts_total", "connect deadlines expired");
+    handshakeTimeouts = m->counter("qtsslcrawl_handshake_timeouts_total", "handshake deadlines expired");
+    totalTimeouts = m->counter("qtsslcrawl_total_timeouts_total", "total request deadlines expired");
+    dnsLookups = m->counter("qtsslcrawl_dns_lookups_total", "DNS lookups started");
+    dnsCacheHits = m->counter("qtsslcrawl_dns_cache_hits_total", "hosts answered from the DNS cache");
+    dnsNotFound = m->counter("qtsslcrawl_dns_not_found_total", "requests dropped because the host does not exist");
+    scheduledChecks = m->counter("qtsslcrawl_scheduled_checks_total",
+                                 "queued calls to check for sending more requests");
+    coalescedChecks = m->counter("qtsslcrawl_coalesced_checks_total",
+                                 "checks merged into an already queued one");
+    routedUrlBatches = m->counter("qtsslcrawl_routed_url_batches_total",
+                                  "batches of URLs routed to other shards");
+    retries = m->counter("qtsslcrawl_retries_total", "failed requests and probes queued for a retry");
+    racedFallbacks = m->counter("qtsslcrawl_raced_fallbacks_total",
+                                "http:// attempts started while https:// was still connecting");
+    cancelledFallbacks = m->counter("qtsslcrawl_cancelled_fallbacks_total",
+                                    "raced http:// attempts cancelled because https:// won");
+    changedChains = m->counter("qtsslcrawl_recrawl_changed_chains_total",
+                               "chains that differ from the previous crawl");
+    unchangedChains = m->counter("qtsslcrawl_recrawl_unchanged_chains_total",
+                                 "chains that are the same as in the previous crawl (not reported)");
+    resultQueueFull = m->counter("qtsslcrawl_result_queue_full_total",
+                                 "results that had to wait for space in the parser queue");
+    pendingRequests = m->gauge("qtsslcrawl_pending_requests", "requests queued in the frontier");
+    resolvingRequests = m->gauge("qtsslcrawl_resolving_requests", "requests waiting for DNS or a connection slot");
+    connections = m->gauge("qtsslcrawl_connections", "requests and probes with an open connection");
+    concurrencyWindow = m->gauge("qtsslcrawl_concurrency_window", "allowed connections, summed over all crawlers");
+    visitedUrls = m->gauge("qtsslcrawl_visited_urls", "URLs in the visited sets");
+    hostCacheEntries = m->gauge("qtsslcrawl_host_cache_entries", "hosts in the host:port caches");
+    resultQueueDepth = m->gauge("qtsslcrawl_result_queue_depth", "results waiting for the parser thread");
+    dnsTime = m->histogram("qtsslcrawl_dns_milliseconds", "duration of DNS lookups");
+    connectTime = m->histogram("qtsslcrawl_connect_milliseconds", "time to connect (probes only)");
+    handshakeTime = m->histogram("qtsslcrawl_handshake_milliseconds",
+                                 "duration of TLS handshakes (for requests including the connect)");
+    firstByteTime = m->histogram("qtsslcrawl_first_byte_milliseconds", "time from sending to the reply header");
+    bodyTime = m->histogram("qtsslcrawl_body_milliseconds", "time from the reply header to the end of the body");
+}
@@ -0,0 +1,152 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QAtomicInteger>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+
+// metrics are updated with relaxed atomic operations only, so they are
+// cheap enough for every request and can be shared by all crawler threads
+class MetricCounter
+{
+public:
+    MetricCounter() : m_value(0) { }
+    void increment(qint64 amount = 1) { m_value.fetchAndAddRelaxed(amount); }
+    qint64 value() const { return m_value.load(); }
+
+private:
+    Q_DISABLE_COPY(MetricCounter)
+    QAtomicInteger<qint64> m_value;
+};
+
+class MetricGauge
+{
+public:
+    MetricGauge() : m_value(0) { }
+    // with several crawlers, every one adds its changes
+    void add(qint64 delta) { m_value.fetchAndAddRelaxed(delta); }
+    qint64 value() const { return m_value.load(); }
+
+private:
+    Q_DISABLE_COPY(MetricGauge)
+    QAtomicInteger<qint64> m_value;
+};
+
+// durations in msecs, in fixed buckets
+class MetricHistogram
+{
+public:
+    MetricHistogram();
+    void observe(qint64 msecs);
+
+    static const int s_bucketCount = 14;
+    static const qint64 s_bucketBounds[s_bucketCount]; // the last bucket is +Inf
+    qint64 bucket(int index) const { return m_buckets[index].load(); }
+    qint64 sum() const { return m_sum.load(); }
+    qint64 count() const { return m_count.load(); }
+
+private:
+    Q_DISABLE_COPY(MetricHistogram)
+    QAtomicInteger<qint64> m_buckets[s_bucketCount + 1];
+    QAtomicInteger<qint64> m_sum;
+    QAtomicInteger<qint64> m_count;
+};
+
+// all metrics of the process; they are created once and never deleted,
+// so the pointers can be kept
+class Metrics
+{
+public:
+    static Metrics *instance();
+
+    MetricCounter *counter(const char *name, const char *help);
+    MetricGauge *gauge(const char *name, const char *help);
+    MetricHistogram *histogram(const char *name, const char *help);
+
+    // the Prometheus text format
+    QByteArray format() const;
+
+private:
+    enum Type { CounterType, GaugeType, HistogramType };
+    class Entry {
+    public:
+        QByteArray name;
+        QByteArray help;
+        Type type;
+        void *metric;
+    };
+
+    void *find(const char *name, Type type) const;
+
+    mutable QMutex m_mutex; // only for registering and formatting
+    QList<Entry> m_entries;
+};
+
+// the metrics the crawler updates
+class CrawlMetrics
+{
+public:
+    static const CrawlMetrics &instance();
+
+    MetricCounter *requestsSent;
+    MetricCounter *probesSent;
+    MetricCounter *requestErrors;
+    MetricCounter *results;
+    MetricCounter *hostCacheHits;
+    MetricCounter *urlsFound;
+    MetricCounter *bodyBytes;
+    MetricCounter *connectTimeouts;
+    MetricCounter *handshakeTimeouts;
+    MetricCounter *totalTimeouts;
+    MetricCounter *dnsLookups;
+    MetricCounter *dnsCacheHits;
+    MetricCounter *dnsNotFound;
+    MetricCounter *scheduledChecks;
+    MetricCounter *coalescedChecks;
+    MetricCounter *routedUrlBatches;
+    MetricCounter *retries;
+    MetricCounter *racedFallbacks;
+    MetricCounter *cancelledFallbacks;
+    MetricCounter *changedChains;
+    MetricCounter *unchangedChains;
+    MetricCounter *resultQueueFull;
+    MetricGauge *pendingRequests;
+    MetricGauge *resolvingRequests;
+    MetricGauge *connections;
+    MetricGauge *concurrencyWindow;
+    MetricGauge *visitedUrls;
+    MetricGauge *hostCacheEntries;
+    MetricGauge *resultQueueDepth;
+    MetricHistogram *dnsTime;
+    MetricHistogram *connectTime;
+    MetricHistogram *handshakeTime;
+    MetricHistogram *firstByteTime;
+    MetricHistogram *bodyTime;
+
+private:
+    CrawlMetrics();
+};
+
+#endif // METRICS_H
@@ -0,0 +1,79 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "metricsexporter.h"
+#include "metrics.h"
+#include "logging.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+
+MetricsExporter::MetricsExporter(QObject *parent) :
+    QObject(parent),
+    m_server(0),
+    m_dumpTimer(0)
+{
+}
+
+bool MetricsExporter::listen(quint16 port) {
+
+    m_server = new QTcpServer(this);
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(newConnection()));
+    // not meant to be reachable from outside
+    if (!m_server->listen(QHostAddress::LocalHost, port)) {
+        qCWarning(lcMetrics, "event=listen_failed port=%d error=\"%s\"", port, qPrintable(m_server->errorString()));
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::startDumping(int interval) {
+
+    m_dumpTimer = new QTimer(this);
+    connect(m_dumpTimer, SIGNAL(timeout()), this, SLOT(dump()));
+    m_dumpTimer->start(interval);
+}
+
+void MetricsExporter::newConnection() {
+
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void MetricsExporter::readRequest() {
+
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+    socket->readAll(); // whatever was asked for, there is only one page
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+    QByteArray body = Metrics::instance()->format();
+    socket->write("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                  + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+    socket->disconnectFromHost();
+}
+
+void MetricsExporter::dump() {
+
+    qCWarning(lcMetrics).noquote() << "event=metrics\n" + QString::fromLatin1(Metrics::instance()->format());
+}
@@ -0,0 +1,52 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+
+class QTcpServer;
+class QTimer;
+
+// makes Metrics::instance() visible: served over HTTP on a local port
+// (every request gets the text format, e.g. for Prometheus) and / or
+// written to the log periodically
+class MetricsExporter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsExporter(QObject *parent = 0);
+
+    bool listen(quint16 port);
+    void startDumping(int interval);
+
+private slots:
+    void newConnection();
+    void readRequest();
+    void dump();
+
+private:
+    QTcpServer *m_server;
+    QTimer *m_dumpTimer;
+};
+
+#endif // METRICSEXPORTER_H
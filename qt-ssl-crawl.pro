@@ -15,13 +15,17 @@ CONFIG   -= app_bundle
 TEMPLATE = app
 
 
-SOURCES += main.cpp \
-    qt-ssl-crawler.cpp \
-    resultparser.cpp
+include(crawler.pri)
 
-HEADERS += \
-    qt-ssl-crawler.h \
-    resultparser.h
+SOURCES += main.cpp
+
+# "make benchmark" builds the benchmark in bench-build/, see bench/bench.pro
+benchmark.commands = $(MKDIR) bench-build && cd bench-build && $$QMAKE_QMAKE $$PWD/bench/bench.pro && $(MAKE)
+QMAKE_EXTRA_TARGETS += benchmark
+
+# "make tests" builds and runs the tests in tests-build/, see tests/tests.pro
+tests.commands = $(MKDIR) tests-build && cd tests-build && $$QMAKE_QMAKE $$PWD/tests/tests.pro && $(MAKE) && $(MAKE) check
+QMAKE_EXTRA_TARGETS += tests
 
 OTHER_FILES +=
 
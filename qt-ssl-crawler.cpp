@@ -20,140 +20,617 @@
 *************************************************************************************/
 
 #include "qt-ssl-crawler.h"
+#include "sharding.h"
+#include "crawlcheckpoint.h"
+#include "hostresolver.h"
+#include "deadlinescheduler.h"
+#include "recrawlplanner.h"
+#include "logging.h"
 #include <QFile>
 #include <QUrl>
-#include <QDebug>
 #include <QNetworkReply>
 #include <QSslCertificate>
 #include <QSslConfiguration>
+#include <QSslSocket>
 #include <QCoreApplication>
 #include <QStringList>
-#include <QThreadPool>
 #include <QTimer>
 
-// in reality the number of open connections is higher than the value below
+#include <limits.h>
+
+// initial value only, adapted at runtime by m_concurrencyLimiter;
+// in reality the number of open connections is higher than the window
 int QtSslCrawler::s_concurrentRequests = 100;
+int QtSslCrawler::s_resultBatchSize = 64;
+// per crawler; most links to a host are found while it is still
+// among the recently crawled ones
+int QtSslCrawler::s_hostCacheSize = 10000;
+qint64 QtSslCrawler::s_snapshotInterval = 10 * 60 * 1000; // 10 minutes
 QNetworkRequest::Attribute QtSslCrawler::s_tryCountAttribute =
         static_cast<QNetworkRequest::Attribute>(QNetworkRequest::User + 1);
 
 QtSslCrawler::QtSslCrawler(QObject *parent, int from, int to) :
     QObject(parent),
     m_manager(new QNetworkAccessManager(this)),
+    m_resolver(0),
+    m_activeConnections(0),
+    m_deadlines(new DeadlineScheduler(this)),
+    m_retryTimer(0),
+    m_metrics(CrawlMetrics::instance()),
+    m_reportedPending(0),
+    m_reportedResolving(0),
+    m_reportedConnections(0),
+    m_reportedVisited(0),
+    m_domainSource(QStringLiteral("top-1m.csv"), from, to),
+    m_domainSourceOpened(false),
+    m_recrawlPlanner(0),
+    m_seedSource(&m_domainSource),
+    m_changedChains(0),
+    m_unchangedChains(0),
     m_crawlFrom(from),
-    m_crawlTo(to)
+    m_crawlTo(to),
+    m_shardIndex(0),
+    m_shardCount(1),
+    m_routedUrlsReceived(0),
+    m_finishReported(false),
+    m_checkScheduled(false),
+    m_resultBatchTimer(0),
+    m_concurrencyLimiter(s_concurrentRequests),
+    m_reportedConcurrencyWindow(s_concurrentRequests),
+    m_probeMode(false),
+    m_maxBodySize(0),
+    m_hostResults(s_hostCacheSize),
+    m_reportedHostCacheEntries(0),
+    m_hostCacheLookups(0),
+    m_hostCacheHits(0),
+    m_checkpoint(0),
+    m_resume(false),
+    m_checkpointTimer(0),
+    m_lastSnapshotTime(0)
 {
-    QFile domainFile(QStringLiteral("top-1m.csv"));
-    if (!domainFile.open(QIODevice::ReadOnly)) {
+    // a re-crawl does not need the file, so we only complain in start()
+    m_domainSourceOpened = m_domainSource.open();
+    // requests are created lazily when there are free slots,
+    // see checkForSendingMoreRequests()
+    m_frontier.setSeedSource(m_seedSource);
+    m_clock.start();
+    m_metrics.concurrencyWindow->add(m_reportedConcurrencyWindow);
+    setHostResolution(50, 900);
+    connect(m_deadlines, SIGNAL(expired(QObject*,int)), this, SLOT(deadlineExpired(QObject*,int)));
+}
+
+QtSslCrawler::~QtSslCrawler() {
+
+    delete m_checkpoint; // flushes the logs and waits for a snapshot being written
+    delete m_recrawlPlanner;
+}
+
+void QtSslCrawler::setShard(int index, int count) {
+
+    m_shardIndex = index;
+    m_shardCount = count;
+    m_domainSource.setShard(index, count);
+    if (m_recrawlPlanner)
+        m_recrawlPlanner->setShard(index, count);
+}
+
+void QtSslCrawler::setRetryPolicy(int maxRetries, int retryDelay) {
+
+    m_retryPolicy.setMaxRetries(maxRetries);
+    m_retryPolicy.setRetryDelay(retryDelay);
+}
+
+void QtSslCrawler::setFallbackDelay(int delay) {
+
+    m_deadlines->setTimeout(DeadlineScheduler::FallbackPhase, delay);
+}
+
+void QtSslCrawler::setRecrawlPlan(const QSharedPointer<const RecrawlPlan> &plan, qint64 timeBudget) {
+
+    delete m_recrawlPlanner;
+    m_recrawlPlanner = new RecrawlPlanner(plan);
+    m_recrawlPlanner->setShard(m_shardIndex, m_shardCount);
+    m_recrawlPlanner->setTimeBudget(timeBudget);
+    m_seedSource = m_recrawlPlanner;
+    m_frontier.setSeedSource(m_seedSource);
+}
+
+void QtSslCrawler::setCheckpoint(const QString &baseName, bool resume) {
+
+    delete m_checkpoint;
+    m_checkpoint = new CrawlCheckpoint(baseName);
+    m_resume = resume;
+}
+
+void QtSslCrawler::setVisitedUrlSetMode(VisitedUrlSet::Mode mode, qint64 bloomFilterCapacity,
+                                        double bloomFilterFalsePositiveRate) {
+
+    m_frontier.visitedUrls().setMode(mode);
+    if (mode == VisitedUrlSet::BloomFilterMode)
+        m_frontier.visitedUrls().setBloomFilterSize(bloomFilterCapacity, bloomFilterFalsePositiveRate);
+}
+
+void QtSslCrawler::setHostResolution(int maxConcurrentLookups, int negativeCacheTime) {
+
+    if (maxConcurrentLookups <= 0) {
+        delete m_resolver;
+        m_resolver = 0;
+        return;
+    }
+    if (!m_resolver) {
+        m_resolver = new HostResolver(this); // moves to our thread with us
+        connect(m_resolver, SIGNAL(requestsResolved()), this, SLOT(hostsResolved()));
+        connect(m_resolver, SIGNAL(hostNotFound(QNetworkRequest)),
+                this, SLOT(hostNotFound(QNetworkRequest)));
+    }
+    m_resolver->setMaxConcurrentLookups(maxConcurrentLookups);
+    m_resolver->setNegativeCacheTime(negativeCacheTime);
+}
+
+void QtSslCrawler::setTimeouts(int connectTimeout, int handshakeTimeout, int totalTimeout) {
+
+    m_deadlines->setTimeout(DeadlineScheduler::ConnectPhase, connectTimeout);
+    m_deadlines->setTimeout(DeadlineScheduler::HandshakePhase, handshakeTimeout);
+    m_deadlines->setTimeout(DeadlineScheduler::TotalPhase, totalTimeout);
+}
+
+void QtSslCrawler::start() {
+    if (!m_recrawlPlanner && !m_domainSourceOpened) {
         qFatal("could not open file 'top-1m.csv', download it from http://s3.amazonaws.com/alexa-static/top-1m.csv.zip");
     }
-    int currentLine = 0;
-    while (!domainFile.atEnd()) {
-        currentLine++;
-        QByteArray line = domainFile.readLine();
-        if (m_crawlFrom == 0 || m_crawlTo == 0 || (m_crawlFrom <= currentLine && currentLine <= m_crawlTo)) {
-            QByteArray domain = line.right(line.count() - line.indexOf(',') - 1).prepend("https://www.");
-            QUrl url = QUrl::fromEncoded(domain.trimmed());
-            QNetworkRequest request(url);
-            // setting the attribute to trace the originating URL,
-            // because we might try different URLs or get redirects
-            request.setAttribute(QNetworkRequest::User, url);
-            queueRequestIfNew(request); // all requests should be new here
-            if (currentLine == m_crawlTo)
-                break; // no need to crawl the rest of the file
+    if (m_checkpoint)
+        startCheckpointing();
+    if (m_shardCount > 1) {
+        // created here so the timer lives in the thread we have been moved to
+        m_resultBatchTimer = new QTimer(this);
+        connect(m_resultBatchTimer, SIGNAL(timeout()), this, SLOT(flushResults()));
+        m_resultBatchTimer->start(1000);
+    }
+    m_retryTimer = new QTimer(this);
+    m_retryTimer->setSingleShot(true);
+    connect(m_retryTimer, SIGNAL(timeout()), this, SLOT(retryDue()));
+    scheduleCheck();
+}
+
+void QtSslCrawler::startCheckpointing() {
+
+    QList<QNetworkRequest> pendingRequests;
+    VisitedUrlSet visitedUrls = m_frontier.visitedUrls(); // empty, but configured
+    QList<CrawlResult> results;
+    qint64 seedPosition = -1;
+    int seedLine = 0;
+    if (m_resume) {
+        if (!m_checkpoint->load(&pendingRequests, &visitedUrls, &seedPosition, &seedLine, &results)) {
+            qFatal("could not load the checkpoint to resume from");
         }
+        m_frontier.restore(pendingRequests, visitedUrls);
+        if (seedPosition >= 0)
+            m_seedSource->restorePosition(seedPosition, seedLine);
+        qCWarning(lcStorage, "event=resume line=%d pending=%d visited=%lld results=%d",
+                  m_seedSource->currentLine(), pendingRequests.count(),
+                  qint64(visitedUrls.count()), results.count());
+    }
+    if (!m_checkpoint->open()) {
+        qFatal("could not open the checkpoint files");
+    }
+    m_frontier.setCheckpoint(m_checkpoint);
+    // the parser has not seen the results from before the resume
+    foreach (const CrawlResult &result, results) {
+        cacheHostResult(result.urlWithCertificate, result.certificateChain);
+        deliverResult(result);
     }
+    writeSnapshot(); // compacts what we have just loaded
+
+    m_checkpointTimer = new QTimer(this);
+    connect(m_checkpointTimer, SIGNAL(timeout()), this, SLOT(checkpointTick()));
+    m_checkpointTimer->start(1000);
 }
 
-void QtSslCrawler::start() {
-    QMetaObject::invokeMethod(this, "checkForSendingMoreRequests", Qt::QueuedConnection);
+void QtSslCrawler::checkpointTick() {
+
+    m_checkpoint->flush();
+    if (m_clock.elapsed() - m_lastSnapshotTime >= s_snapshotInterval)
+        writeSnapshot();
 }
 
-void QtSslCrawler::foundUrl(const QUrl &foundUrl, const QUrl &originalUrl) {
+void QtSslCrawler::writeSnapshot() {
 
-    QNetworkRequest request(foundUrl);
-    request.setAttribute(QNetworkRequest::User, originalUrl);
-    queueRequestIfNew(request);
-    QMetaObject::invokeMethod(this, "checkForSendingMoreRequests", Qt::QueuedConnection);
+    m_lastSnapshotTime = m_clock.elapsed();
+    m_checkpoint->writeSnapshot(m_frontier.pendingRequests(), m_frontier.visitedUrls(),
+                                m_seedSource->position(), m_seedSource->currentLine());
 }
 
-void QtSslCrawler::timeout() {
-    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender()->parent());
-    finishRequest(reply);
-    QNetworkRequest request = reply->request();
-    int tryCount = request.attribute(QtSslCrawler::s_tryCountAttribute).toInt();
-    if (tryCount == 0) {
-        qDebug() << "timeout, re-scheduling request for" << request.url();
-        tryCount++;
-        QNetworkRequest newRequest(request);
-        newRequest.setAttribute(QtSslCrawler::s_tryCountAttribute, QVariant(tryCount));
-        m_visitedUrls.remove(reply->request().url()); // hack (has just been inserted by finishRequest)
-        queueRequestIfNew(newRequest);
-    } else {
-        qDebug() << "timeout, tried" << request.url() << "twice, giving up.";
+void QtSslCrawler::addRoutedUrls(const QList<FoundUrl> &urls) {
+
+    m_routedUrlsReceived += urls.count();
+    m_finishReported = false; // report again, the pool waits for our count
+    foreach (const FoundUrl &url, urls) {
+        QNetworkRequest request(url.url);
+        request.setAttribute(QNetworkRequest::User, url.originalUrl);
+        queueRequestIfNew(request);
     }
+    scheduleCheck();
+}
+
+void QtSslCrawler::flushResults() {
+
+    if (!m_resultBatch.isEmpty()) {
+        emit crawlResults(m_resultBatch);
+        m_resultBatch.clear();
+    }
+}
+
+void QtSslCrawler::deadlineExpired(QObject *attempt, int phase) {
+
+    if (phase == DeadlineScheduler::FallbackPhase) {
+        startRacingFallback(attempt);
+        return;
+    }
+    static const char * const phaseNames[] = { "connect", "handshake", "total" };
+    MetricCounter * const timeoutCounters[] = {
+        m_metrics.connectTimeouts, m_metrics.handshakeTimeouts, m_metrics.totalTimeouts
+    };
+    timeoutCounters[phase]->increment();
+    // a total timeout after the headers arrived was counted as a success already
+    if (countCompletion(attempt))
+        m_concurrencyLimiter.requestTimedOut();
+    QNetworkRequest request = attemptRequest(attempt);
+    qCDebug(lcCrawler, "event=timeout phase=%s url=%s", phaseNames[phase], qUtf8Printable(request.url().toString()));
+    handleFailure(attempt, RetryPolicy::TransientError);
+    if (QSslSocket *socket = qobject_cast<QSslSocket *>(attempt))
+        finishProbe(socket);
+    else
+        finishRequest(qobject_cast<QNetworkReply*>(attempt));
     // we called checkForSendingMoreRequests() implicitly with finishRequest()
 }
 
+QNetworkRequest QtSslCrawler::attemptRequest(QObject *attempt) const {
+
+    if (QSslSocket *socket = qobject_cast<QSslSocket *>(attempt))
+        return m_probes.value(socket);
+    return qobject_cast<QNetworkReply*>(attempt)->request();
+}
+
+void QtSslCrawler::retryDue() {
+
+    scheduleCheck();
+}
+
+void QtSslCrawler::hostsResolved() {
+
+    scheduleCheck();
+}
+
+void QtSslCrawler::scheduleCheck() {
+
+    // a page full of links, a batch of routed URLs and many finished
+    // requests in one event loop iteration all need just one check
+    if (m_checkScheduled) {
+        m_metrics.coalescedChecks->increment();
+        return;
+    }
+    m_checkScheduled = true;
+    m_metrics.scheduledChecks->increment();
+    QMetaObject::invokeMethod(this, "checkForSendingMoreRequests", Qt::QueuedConnection);
+}
+
+void QtSslCrawler::flushForeignUrls() {
+
+    if (!m_foreignUrls.isEmpty()) {
+        emit foreignUrlsFound(m_foreignUrls);
+        m_foreignUrls.clear();
+    }
+}
+
+void QtSslCrawler::hostNotFound(const QNetworkRequest &request) {
+
+    // no need to try http:// either, it is the same host
+    qCDebug(lcDns, "event=drop_request url=%s reason=host_not_found", qUtf8Printable(request.url().toString()));
+    // a raced http:// request is never sent now, see sendRequest()
+    m_racingFallbacks.remove(request.url());
+    m_cancelledFallbacks.remove(request.url());
+    m_frontier.markVisited(request.url());
+    scheduleCheck();
+}
+
 void QtSslCrawler::checkForSendingMoreRequests() {
 
-    while (m_urlsWaitForFinished.count() < s_concurrentRequests
-           && m_requestsToSend.count() > 0) {
-        QNetworkRequest request = m_requestsToSend.dequeue();
-        sendRequest(request);
+    m_checkScheduled = false;
+    if (m_concurrencyLimiter.window() != m_reportedConcurrencyWindow) {
+        m_metrics.concurrencyWindow->add(m_concurrencyLimiter.window() - m_reportedConcurrencyWindow);
+        m_reportedConcurrencyWindow = m_concurrencyLimiter.window();
+        qCDebug(lcCrawler, "event=concurrency_window window=%d", m_reportedConcurrencyWindow);
     }
+    // the window only limits open connections; with a resolver we keep
+    // about as many requests resolving (or resolved) ahead of them
+    forever {
+        if (m_resolver) {
+            while (m_resolver->queuedCount() < m_concurrencyLimiter.window()
+                   && m_frontier.hasPending()) {
+                QNetworkRequest request = m_frontier.takeNext();
+                if (!reportCachedResult(request))
+                    m_resolver->resolve(request);
+            }
+        }
+        if (m_activeConnections >= m_concurrencyLimiter.window()
+                || (m_resolver ? !m_resolver->hasResolved() : !m_frontier.hasPending()))
+            break;
+        while (m_activeConnections < m_concurrencyLimiter.window()
+               && (m_resolver ? m_resolver->hasResolved() : m_frontier.hasPending())) {
+            if (m_resolver) {
+                sendRequest(m_resolver->takeResolved()); // checked the cache already
+            } else {
+                QNetworkRequest request = m_frontier.takeNext();
+                if (!reportCachedResult(request))
+                    sendRequest(request);
+            }
+        }
+    }
+    updateGauges();
+    if (m_retryTimer) {
+        qint64 nextRetry = m_frontier.msecsToNextRetry();
+        if (nextRetry >= 0)
+            m_retryTimer->start(int(qMin<qint64>(nextRetry, INT_MAX)));
+    }
+    flushForeignUrls(); // before reporting idle, the pool counts them
+    checkIfFinished();
 }
 
-void QtSslCrawler::queueRequestIfNew(const QNetworkRequest &request) {
+void QtSslCrawler::updateGauges() {
+
+    // the gauges are shared by all crawlers, so we add our changes only
+    qint64 pending = m_frontier.pendingCount();
+    qint64 resolving = m_resolver ? m_resolver->queuedCount() : 0;
+    qint64 visited = m_frontier.visitedUrls().count();
+    qint64 hostCacheEntries = m_hostResults.count();
+    m_metrics.pendingRequests->add(pending - m_reportedPending);
+    m_metrics.resolvingRequests->add(resolving - m_reportedResolving);
+    m_metrics.connections->add(m_activeConnections - m_reportedConnections);
+    m_metrics.visitedUrls->add(visited - m_reportedVisited);
+    m_metrics.hostCacheEntries->add(hostCacheEntries - m_reportedHostCacheEntries);
+    m_reportedPending = pending;
+    m_reportedResolving = resolving;
+    m_reportedConnections = m_activeConnections;
+    m_reportedVisited = visited;
+    m_reportedHostCacheEntries = hostCacheEntries;
+}
 
-    if (!m_visitedUrls.contains(request.url())
-        && !m_urlsWaitForFinished.contains(request.url())
-        && !m_requestsToSend.contains(request)) {
-        m_requestsToSend.enqueue(request);
+void QtSslCrawler::checkIfFinished() {
+
+    if (m_frontier.isIdle() && !m_finishReported) {
+        m_finishReported = true;
+        flushResults();
+        if (m_checkpoint)
+            m_checkpoint->flush();
+        qCWarning(lcCrawler, "event=crawl_idle shard=%d concurrency_window=%d window_floor=%d window_ceiling=%d",
+                  m_shardIndex, m_concurrencyLimiter.window(),
+                  m_concurrencyLimiter.floor(), m_concurrencyLimiter.ceiling());
+        qCWarning(lcCrawler, "event=visited_set shard=%d urls=%lld bytes=%lld bytes_estimated=%d", m_shardIndex,
+                  qint64(m_frontier.visitedUrls().count()), qint64(m_frontier.visitedUrls().memoryUsage()),
+                  int(m_frontier.visitedUrls().memoryUsageIsEstimate()));
+        if (m_resolver)
+            qCWarning(lcDns, "event=dns_summary shard=%d lookups=%lld cache_hits=%lld dropped_requests=%lld",
+                      m_shardIndex, m_resolver->lookupCount(), m_resolver->cacheHitCount(),
+                      m_resolver->notFoundCount());
+        qCWarning(lcCrawler, "event=host_cache shard=%d entries=%d lookups=%lld hits=%lld hit_rate=%.1f%%",
+                  m_shardIndex, m_hostResults.count(), m_hostCacheLookups, m_hostCacheHits,
+                  m_hostCacheLookups ? 100.0 * m_hostCacheHits / m_hostCacheLookups : 0.0);
+        qCWarning(lcCrawler, "event=timeouts shard=%d connect=%lld handshake=%lld total=%lld", m_shardIndex,
+                  m_deadlines->expiredCount(DeadlineScheduler::ConnectPhase),
+                  m_deadlines->expiredCount(DeadlineScheduler::HandshakePhase),
+                  m_deadlines->expiredCount(DeadlineScheduler::TotalPhase));
+        if (m_recrawlPlanner)
+            qCWarning(lcCrawler, "event=recrawl_summary shard=%d planned=%d checked=%lld changed=%lld unchanged=%lld",
+                      m_shardIndex, m_recrawlPlanner->plan().sites().count(), m_recrawlPlanner->position(),
+                      m_changedChains, m_unchangedChains);
+        if (m_shardCount > 1)
+            emit idle(m_routedUrlsReceived);
+        else
+            emit crawlFinished();
+    }
+}
+
+void QtSslCrawler::queueRequestIfNew(const QNetworkRequest &request, bool first) {
+
+    if (shardForHost(request.url().host(), m_shardCount) != m_shardIndex) {
+        FoundUrl url;
+        url.url = request.url();
+        url.originalUrl = request.attribute(QNetworkRequest::User).toUrl();
+        m_foreignUrls.append(url); // sent with the next check, see flushForeignUrls()
+    } else if (m_frontier.enqueueIfNew(request, first)) {
+        m_finishReported = false;
     } else {
-        qDebug() << "visited" << request.url() << "already or visiting it currently";
+        qCDebug(lcCrawler, "event=skip_url url=%s reason=known", qUtf8Printable(request.url().toString()));
     }
 }
 
 void QtSslCrawler::sendRequest(const QNetworkRequest &request) {
 
-    qDebug() << "sending request for" << request.url();
+    if (m_cancelledFallbacks.remove(request.url())) {
+        // https:// won the race while this one was waiting
+        m_frontier.markVisited(request.url());
+        return;
+    }
+    if (m_probeMode && request.url().scheme() == QLatin1String("https")) {
+        sendProbe(request);
+        return;
+    }
+    qCDebug(lcCrawler, "event=send_request url=%s", qUtf8Printable(request.url().toString()));
+    m_metrics.requestsSent->increment();
     QNetworkRequest newRequest(request);
     // do not keep connections open, we will not issue
     // more than one request to the same host
     newRequest.setRawHeader("Connection", "close");
     QNetworkReply *reply = m_manager->get(newRequest);
-    // if there is neither error nor success after 5 minutes,
-    // try again one more time and then skip the URL.
-    // (The timer will be destroyed if the reply finished after 5 minutes)
-    QTimer *timer = new QTimer(reply);
-    connect(timer, SIGNAL(timeout()), this, SLOT(timeout()));
-    timer->setSingleShot(true);
-    timer->start(300000); // 5 minutes
+    m_activeConnections++;
+    QHash<QUrl, QNetworkReply *>::iterator racingFallback = m_racingFallbacks.find(request.url());
+    if (racingFallback != m_racingFallbacks.end())
+        racingFallback.value() = reply;
+    reply->setProperty("crawlSendTime", m_clock.elapsed());
+    // if there is neither error nor success in time, it is handled like a
+    // temporary error, see handleFailure(). The reply does not tell us when it is
+    // connected, so the connect deadline lasts until encrypted() or, for http,
+    // the first header; for https the handshake deadline covers connecting, too.
+    m_deadlines->schedule(reply, DeadlineScheduler::ConnectPhase);
+    m_deadlines->schedule(reply, DeadlineScheduler::TotalPhase);
+    if (request.url().scheme() == QLatin1String("https")) {
+        m_deadlines->schedule(reply, DeadlineScheduler::HandshakePhase);
+        connect(reply, SIGNAL(encrypted()), this, SLOT(replyEncrypted()));
+        if (canFallBack(request.url(), request.attribute(QNetworkRequest::User).toUrl()))
+            m_deadlines->schedule(reply, DeadlineScheduler::FallbackPhase);
+    }
 
     reply->ignoreSslErrors(); // we don't care, we just want the certificate
     connect(reply, SIGNAL(metaDataChanged()), this, SLOT(replyMetaDataChanged()));
     connect(reply, SIGNAL(error(QNetworkReply::NetworkError)),
             this, SLOT(replyError(QNetworkReply::NetworkError)));
+    connect(reply, SIGNAL(readyRead()), this, SLOT(replyReadyRead()));
     connect(reply, SIGNAL(finished()), this, SLOT(replyFinished()));
+}
 
-    m_urlsWaitForFinished.insert(request.url());
+void QtSslCrawler::sendProbe(const QNetworkRequest &request) {
+
+    qCDebug(lcCrawler, "event=send_probe url=%s", qUtf8Printable(request.url().toString()));
+    m_metrics.probesSent->increment();
+    // we only want the certificate chain, so just do the handshake
+    // and close the connection without sending a request
+    QSslSocket *socket = new QSslSocket(this);
+    m_probes.insert(socket, request);
+    m_activeConnections++;
+    socket->setProperty("crawlSendTime", m_clock.elapsed());
+    m_deadlines->schedule(socket, DeadlineScheduler::ConnectPhase); // see sendRequest()
+    m_deadlines->schedule(socket, DeadlineScheduler::TotalPhase);
+    if (canFallBack(request.url(), request.attribute(QNetworkRequest::User).toUrl()))
+        m_deadlines->schedule(socket, DeadlineScheduler::FallbackPhase);
+
+    socket->ignoreSslErrors(); // we don't care, we just want the certificate
+    connect(socket, SIGNAL(connected()), this, SLOT(probeConnected()));
+    connect(socket, SIGNAL(encrypted()), this, SLOT(probeEncrypted()));
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)),
+            this, SLOT(probeError(QAbstractSocket::SocketError)));
+    socket->connectToHostEncrypted(request.url().host(), request.url().port(443));
+}
+
+void QtSslCrawler::finishProbe(QSslSocket *socket) {
+
+    socket->disconnect(this);
+    m_deadlines->cancelAll(socket);
+    socket->abort();
+    socket->deleteLater();
+    m_activeConnections--;
+    m_frontier.markVisited(m_probes.take(socket).url());
+    scheduleCheck();
 }
 
 void QtSslCrawler::finishRequest(QNetworkReply *reply) {
 
     reply->disconnect(SIGNAL(metaDataChanged()));
     reply->disconnect(SIGNAL(error(QNetworkReply::NetworkError)));
+    reply->disconnect(SIGNAL(readyRead()));
     reply->disconnect(SIGNAL(finished()));
+    reply->disconnect(SIGNAL(encrypted()));
+    m_deadlines->cancelAll(reply);
+    m_metrics.bodyBytes->increment(m_urlExtractors.take(reply).bytesScanned());
+    m_racingFallbacks.remove(reply->request().url());
     reply->close();
     reply->abort();
     reply->deleteLater();
-    m_visitedUrls.insert(reply->request().url());
-    m_urlsWaitForFinished.remove(reply->request().url());
-    qDebug() << "finishRequest pending requests:" << m_requestsToSend.count() + m_urlsWaitForFinished.count();
-    QMetaObject::invokeMethod(this, "checkForSendingMoreRequests", Qt::QueuedConnection);
-    if (m_urlsWaitForFinished.count() + m_requestsToSend.count() == 0) {
-        emit crawlFinished();
+    m_activeConnections--;
+    m_frontier.markVisited(reply->request().url());
+    // this will also check whether we are done
+    scheduleCheck();
+}
+
+void QtSslCrawler::reportResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                                const QList<QSslCertificate> &certificateChain) {
+
+    if (m_recrawlPlanner) {
+        // the previous results are still good for unchanged chains
+        if (m_recrawlPlanner->plan().isUnchanged(urlWithCertificate, certificateChain)) {
+            m_unchangedChains++;
+            m_metrics.unchangedChains->increment();
+            return;
+        }
+        m_changedChains++;
+        m_metrics.changedChains->increment();
     }
+    CrawlResult result;
+    result.originalUrl = originalUrl;
+    result.urlWithCertificate = urlWithCertificate;
+    result.certificateChain = certificateChain;
+    m_metrics.results->increment();
+    if (m_checkpoint)
+        m_checkpoint->resultFound(result);
+    if (urlWithCertificate.scheme() == QLatin1String("https"))
+        cacheHostResult(urlWithCertificate, certificateChain);
+    deliverResult(result);
+}
+
+void QtSslCrawler::cacheHostResult(const QUrl &urlWithCertificate,
+                                   const QList<QSslCertificate> &certificateChain) {
+
+    // the parser only needs the site and the root certificate
+    HostResult *hostResult = new HostResult;
+    hostResult->urlWithCertificate = urlWithCertificate;
+    hostResult->siteCertificate = certificateChain.first();
+    if (certificateChain.count() > 1)
+        hostResult->rootCertificate = certificateChain.last();
+    m_hostResults.insert(hostCacheKey(urlWithCertificate), hostResult); // drops the least recently used
+}
+
+QString QtSslCrawler::hostCacheKey(const QUrl &url) {
+
+    return url.host() + QLatin1Char(':') + QString::number(url.port(443));
+}
+
+bool QtSslCrawler::reportCachedResult(const QNetworkRequest &request) {
+
+    // the certificate belongs to host:port, no matter which URL got us there
+    if (request.url().scheme() != QLatin1String("https"))
+        return false;
+    m_hostCacheLookups++;
+    HostResult *hostResult = m_hostResults.object(hostCacheKey(request.url())); // now most recently used
+    if (!hostResult)
+        return false;
+    m_hostCacheHits++;
+    m_metrics.hostCacheHits->increment();
+    // copied, reportResult() replaces the entry; the chain is only the
+    // site and the root certificate, that is all the parser looks at
+    QUrl urlWithCertificate = hostResult->urlWithCertificate;
+    QList<QSslCertificate> certificateChain;
+    certificateChain << hostResult->siteCertificate;
+    if (!hostResult->rootCertificate.isNull())
+        certificateChain << hostResult->rootCertificate;
+    QUrl originalUrl = request.attribute(QNetworkRequest::User).toUrl();
+    qCDebug(lcCrawler, "event=certificate_found url=%s source=host_cache original_url=%s",
+            qUtf8Printable(request.url().toString()), qUtf8Printable(originalUrl.toString()));
+    // reported for the URL we got it from, so the parser merges both
+    reportResult(originalUrl, urlWithCertificate, certificateChain);
+    m_frontier.markVisited(request.url());
+    return true;
+}
+
+void QtSslCrawler::deliverResult(const CrawlResult &result) {
+
+    if (m_shardCount > 1) {
+        // in shard mode we are running in our own thread, send
+        // the results in batches to keep cross-thread signals low
+        m_resultBatch.append(result);
+        if (m_resultBatch.count() >= s_resultBatchSize)
+            flushResults();
+    } else {
+        emit crawlResult(result.originalUrl, result.urlWithCertificate, result.certificateChain);
+    }
+}
+
+// returns true the first time it is called for a reply or probe,
+// so the concurrency limiter sees every request only once
+bool QtSslCrawler::countCompletion(QObject *attempt) {
+
+    if (attempt->property("crawlCompletionCounted").toBool())
+        return false;
+    attempt->setProperty("crawlCompletionCounted", true);
+    return true;
 }
 
 void QtSslCrawler::replyMetaDataChanged() {
@@ -162,20 +639,30 @@ void QtSslCrawler::replyMetaDataChanged() {
     QUrl currentUrl = reply->url();
     QUrl originalUrl = reply->request().attribute(QNetworkRequest::User).toUrl();
 
-    qDebug() << "replyMetaDataChanged" << currentUrl << "original url:" << originalUrl;
+    qCDebug(lcCrawler, "event=reply_header url=%s original_url=%s",
+            qUtf8Printable(currentUrl.toString()), qUtf8Printable(originalUrl.toString()));
+    m_deadlines->cancel(reply, DeadlineScheduler::ConnectPhase); // see sendRequest()
+
+    if (reply->error() == QNetworkReply::NoError && countCompletion(reply)) {
+        int latency = m_clock.elapsed() - reply->property("crawlSendTime").toLongLong();
+        m_concurrencyLimiter.requestSucceeded(latency);
+        m_metrics.firstByteTime->observe(latency);
+        reply->setProperty("crawlFirstByteTime", m_clock.elapsed());
+    }
 
     if (reply->error() == QNetworkReply::NoError) {
         if (currentUrl.scheme() == QLatin1String("https")) {
             // success, https://[domain] exists and serves meaningful content
             QList<QSslCertificate> chain = reply->sslConfiguration().peerCertificateChain();
             if (!chain.empty()) {
-                QStringList organizations = chain.last().issuerInfo(QSslCertificate::Organization);
-                emit crawlResult(originalUrl, currentUrl, chain);
-                qDebug() << "found ssl cert at" << currentUrl
-                        << "organizations:" << organizations << ", coming from" << originalUrl;
+                reportResult(originalUrl, currentUrl, chain);
+                reply->setProperty("crawlResultReported", true); // see handleFailure()
+                qCDebug(lcCrawler, "event=certificate_found url=%s source=request original_url=%s issuer=\"%s\"",
+                        qUtf8Printable(currentUrl.toString()), qUtf8Printable(originalUrl.toString()),
+                        qUtf8Printable(chain.last().issuerInfo(QSslCertificate::Organization).join(QLatin1Char(','))));
             } else {
                 // never saw that happen
-                qWarning() << "weird: no errors but certificate chain is empty for " << reply->url();
+                qCWarning(lcCrawler, "event=empty_chain url=%s", qUtf8Printable(reply->url().toString()));
             }
 
         } else if (currentUrl.scheme() == QLatin1String("http")) {
@@ -187,24 +674,24 @@ void QtSslCrawler::replyMetaDataChanged() {
                     locationHeader = reply->rawHeader("Location");
                 QUrl newUrl = QUrl::fromEncoded(locationHeader);
                 if (!newUrl.isEmpty()) {
-                    qDebug() << "found redirect header at" << currentUrl << "to" << newUrl;
+                    qCDebug(lcCrawler, "event=redirect url=%s location=%s",
+                            qUtf8Printable(currentUrl.toString()), qUtf8Printable(newUrl.toString()));
                     QNetworkRequest request(newUrl);
                     request.setAttribute(QNetworkRequest::User, originalUrl);
                     queueRequestIfNew(request);
-                    QMetaObject::invokeMethod(this, "checkForSendingMoreRequests", Qt::QueuedConnection);
+                    scheduleCheck();
                 }
-            } else {
-                qDebug() << "meta data changed for" << currentUrl << "do nothing I guess, wait for finished";
             }
         } else {
             // never saw that happen
-            qWarning() << "scheme for" << currentUrl << "is neither https nor http";
+            qCWarning(lcCrawler, "event=unknown_scheme url=%s", qUtf8Printable(currentUrl.toString()));
         }
 
     } else { // there was an error
 
         // does not happen
-        qDebug() << "error with" << currentUrl << reply->errorString();
+        qCDebug(lcCrawler, "event=reply_error url=%s error=\"%s\"",
+                qUtf8Printable(currentUrl.toString()), qUtf8Printable(reply->errorString()));
     }
 }
 
@@ -214,24 +701,185 @@ void QtSslCrawler::replyError(QNetworkReply::NetworkError error) {
     QUrl currentUrl = reply->url();
     QUrl originalUrl = reply->request().attribute(QNetworkRequest::User).toUrl();
 
-    qDebug() << "replyError" << error << currentUrl << reply->errorString() << "original url:" << originalUrl;
-    // 2nd try: if https://[domain] does not work, fetch
-    // http://[domain] and parse the HTML for https:// URLs
+    RetryPolicy::ErrorClass errorClass = RetryPolicy::classify(error);
+    qCDebug(lcCrawler, "event=reply_error url=%s code=%d error_class=%s error=\"%s\" original_url=%s",
+            qUtf8Printable(currentUrl.toString()), int(error), RetryPolicy::className(errorClass),
+            qUtf8Printable(reply->errorString()), qUtf8Printable(originalUrl.toString()));
+    m_metrics.requestErrors->increment();
+    if (countCompletion(reply))
+        m_concurrencyLimiter.requestFailed();
+    handleFailure(reply, errorClass);
+    finishRequest(reply);
+}
+
+// must be called before the attempt is finished: a request
+// to be retried must not be marked as visited
+void QtSslCrawler::handleFailure(QObject *attempt, RetryPolicy::ErrorClass errorClass) {
+
+    QNetworkRequest request = attemptRequest(attempt);
+    QUrl originalUrl = request.attribute(QNetworkRequest::User).toUrl();
+    if (attempt->property("crawlResultReported").toBool()) {
+        // e.g. a 5xx or a timeout while reading the body: we have the
+        // certificate, another try would only report it again
+        qCDebug(lcCrawler, "event=give_up url=%s error_class=%s reason=result_reported",
+                qUtf8Printable(request.url().toString()), RetryPolicy::className(errorClass));
+        return;
+    }
+    int tryCount = request.attribute(QtSslCrawler::s_tryCountAttribute).toInt();
+    switch (m_retryPolicy.action(errorClass, tryCount)) {
+    case RetryPolicy::Retry: {
+        int delay = m_retryPolicy.retryDelay(tryCount);
+        qCDebug(lcCrawler, "event=retry url=%s error_class=%s try=%d delay=%d",
+                qUtf8Printable(request.url().toString()), RetryPolicy::className(errorClass), tryCount + 1, delay);
+        m_metrics.retries->increment();
+        QNetworkRequest newRequest(request);
+        newRequest.setAttribute(QtSslCrawler::s_tryCountAttribute, QVariant(tryCount + 1));
+        m_frontier.retryLater(newRequest, delay);
+        break;
+    }
+    case RetryPolicy::FallBack:
+        queueHttpFallback(request.url(), originalUrl);
+        break;
+    case RetryPolicy::GiveUp:
+        qCDebug(lcCrawler, "event=give_up url=%s error_class=%s original_url=%s",
+                qUtf8Printable(request.url().toString()), RetryPolicy::className(errorClass),
+                qUtf8Printable(originalUrl.toString()));
+        break;
+    }
+}
+
+bool QtSslCrawler::canFallBack(const QUrl &currentUrl, const QUrl &originalUrl) const {
+
+    // only for our blind check of https://[domain];
+    // a re-crawl only checks the sites it knows about
+    return originalUrl.host() == currentUrl.host() && currentUrl.scheme() == QLatin1String("https")
+            && !m_recrawlPlanner;
+}
 
-    // ### check which error we got
+void QtSslCrawler::queueHttpFallback(const QUrl &currentUrl, const QUrl &originalUrl) {
 
-    // our blind check for https://[domain] was not succesful, try http://[domain] now
-    if (originalUrl.host() == currentUrl.host() && currentUrl.scheme() == QLatin1String("https")) {
+    // 2nd try: if https://[domain] does not work, fetch
+    // http://[domain] and parse the HTML for https:// URLs.
+    // Sent before everything else, this site has waited already.
+    if (canFallBack(currentUrl, originalUrl)) {
         QUrl newUrl = currentUrl;
         newUrl.setScheme(QStringLiteral("http"));
         QNetworkRequest newRequest(newUrl); // ### probably we can just copy it
         newRequest.setAttribute(QNetworkRequest::User, newUrl);
-        qDebug() << "queueing new request" << newUrl << "original url:" << newUrl;
-        queueRequestIfNew(newRequest);
+        qCDebug(lcCrawler, "event=http_fallback url=%s", qUtf8Printable(newUrl.toString()));
+        queueRequestIfNew(newRequest, true);
     } else {
-        qWarning() << "could not fetch" << currentUrl << "original url:" << originalUrl; // ### try again?
+        qCDebug(lcCrawler, "event=fetch_failed url=%s original_url=%s",
+                qUtf8Printable(currentUrl.toString()), qUtf8Printable(originalUrl.toString()));
+    }
+}
+
+void QtSslCrawler::startRacingFallback(QObject *attempt) {
+
+    // https:// has not connected in time, maybe nothing answers on port 443:
+    // try http:// at the same time instead of waiting for the timeout
+    // (like "Happy Eyeballs" does for IPv6 and IPv4)
+    QNetworkRequest request = attemptRequest(attempt);
+    QUrl httpUrl = request.url();
+    httpUrl.setScheme(QStringLiteral("http"));
+    if (m_frontier.state(httpUrl) != CrawlFrontier::Unknown)
+        return;
+    qCDebug(lcCrawler, "event=http_race url=%s", qUtf8Printable(httpUrl.toString()));
+    m_metrics.racedFallbacks->increment();
+    m_racingFallbacks.insert(httpUrl, 0);
+    queueHttpFallback(request.url(), request.attribute(QNetworkRequest::User).toUrl());
+    scheduleCheck();
+}
+
+void QtSslCrawler::cancelRacingFallback(const QUrl &httpsUrl) {
+
+    QUrl httpUrl = httpsUrl;
+    httpUrl.setScheme(QStringLiteral("http"));
+    QHash<QUrl, QNetworkReply *>::iterator it = m_racingFallbacks.find(httpUrl);
+    if (it == m_racingFallbacks.end())
+        return;
+    QNetworkReply *reply = it.value();
+    m_racingFallbacks.erase(it);
+    qCDebug(lcCrawler, "event=http_race_lost url=%s", qUtf8Printable(httpUrl.toString()));
+    m_metrics.cancelledFallbacks->increment();
+    if (reply)
+        finishRequest(reply);
+    else
+        m_cancelledFallbacks.insert(httpUrl); // see sendRequest()
+}
+
+void QtSslCrawler::replyEncrypted() {
+
+    m_deadlines->cancel(sender(), DeadlineScheduler::ConnectPhase);
+    m_deadlines->cancel(sender(), DeadlineScheduler::HandshakePhase);
+    m_deadlines->cancel(sender(), DeadlineScheduler::FallbackPhase);
+    cancelRacingFallback(qobject_cast<QNetworkReply *>(sender())->request().url());
+    m_metrics.handshakeTime->observe(m_clock.elapsed() - sender()->property("crawlSendTime").toLongLong());
+}
+
+void QtSslCrawler::probeConnected() {
+
+    QSslSocket *socket = qobject_cast<QSslSocket *>(sender());
+    m_deadlines->cancel(socket, DeadlineScheduler::ConnectPhase);
+    // port 443 answers, so there is TLS most likely; if not, we fall back after the error
+    m_deadlines->cancel(socket, DeadlineScheduler::FallbackPhase);
+    m_deadlines->schedule(socket, DeadlineScheduler::HandshakePhase);
+    socket->setProperty("crawlConnectedTime", m_clock.elapsed());
+    m_metrics.connectTime->observe(m_clock.elapsed() - socket->property("crawlSendTime").toLongLong());
+}
+
+void QtSslCrawler::probeEncrypted() {
+
+    QSslSocket *socket = qobject_cast<QSslSocket *>(sender());
+    QNetworkRequest request = m_probes.value(socket);
+    QUrl originalUrl = request.attribute(QNetworkRequest::User).toUrl();
+    if (countCompletion(socket)) {
+        int latency = m_clock.elapsed() - socket->property("crawlSendTime").toLongLong();
+        m_concurrencyLimiter.requestSucceeded(latency);
+    }
+    m_metrics.handshakeTime->observe(m_clock.elapsed() - socket->property("crawlConnectedTime").toLongLong());
+    cancelRacingFallback(request.url());
+    QList<QSslCertificate> chain = socket->peerCertificateChain();
+    if (!chain.empty()) {
+        reportResult(originalUrl, request.url(), chain);
+        qCDebug(lcCrawler, "event=certificate_found url=%s source=probe original_url=%s",
+                qUtf8Printable(request.url().toString()), qUtf8Printable(originalUrl.toString()));
+    } else {
+        qCWarning(lcCrawler, "event=empty_chain url=%s", qUtf8Printable(request.url().toString()));
+    }
+    finishProbe(socket);
+}
+
+void QtSslCrawler::probeError(QAbstractSocket::SocketError error) {
+
+    QSslSocket *socket = qobject_cast<QSslSocket *>(sender());
+    QNetworkRequest request = m_probes.value(socket);
+    QUrl originalUrl = request.attribute(QNetworkRequest::User).toUrl();
+
+    RetryPolicy::ErrorClass errorClass = RetryPolicy::classify(error);
+    qCDebug(lcCrawler, "event=probe_error url=%s code=%d error_class=%s error=\"%s\" original_url=%s",
+            qUtf8Printable(request.url().toString()), int(error), RetryPolicy::className(errorClass),
+            qUtf8Printable(socket->errorString()), qUtf8Printable(originalUrl.toString()));
+    m_metrics.requestErrors->increment();
+    if (countCompletion(socket))
+        m_concurrencyLimiter.requestFailed();
+    handleFailure(socket, errorClass);
+    finishProbe(socket);
+}
+
+void QtSslCrawler::replyReadyRead() {
+
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    // scan the body while it arrives, only the extractor's carry-over is kept
+    UrlExtractor &extractor = m_urlExtractors[reply];
+    extractor.feed(reply->readAll());
+    if (m_maxBodySize > 0 && extractor.bytesScanned() > m_maxBodySize) {
+        qCDebug(lcCrawler, "event=body_too_large url=%s limit=%lld",
+                qUtf8Printable(reply->url().toString()), m_maxBodySize);
+        if (reply->error() == QNetworkReply::NoError)
+            queueFoundUrls(reply);
+        finishRequest(reply);
     }
-    finishRequest(reply);
 }
 
 void QtSslCrawler::replyFinished() {
@@ -240,36 +888,41 @@ void QtSslCrawler::replyFinished() {
     QUrl currentUrl = reply->url();
     QUrl originalUrl = reply->request().attribute(QNetworkRequest::User).toUrl();
     if (reply->error() == QNetworkReply::NoError) {
-        qDebug() << "reply finished:" << currentUrl << "original url:" << originalUrl << ", now grep for urls";
-        QByteArray replyData = reply->readAll();
-        // now start the job to find URLs in a new thread
-        UrlFinderRunnable *runnable = new UrlFinderRunnable(replyData, originalUrl, currentUrl);
-        connect(runnable, SIGNAL(foundUrl(QUrl,QUrl)), this, SLOT(foundUrl(QUrl,QUrl)), Qt::QueuedConnection);
-        QThreadPool::globalInstance()->start(runnable);
+        qCDebug(lcCrawler, "event=reply_finished url=%s original_url=%s",
+                qUtf8Printable(currentUrl.toString()), qUtf8Printable(originalUrl.toString()));
+        QVariant firstByteTime = reply->property("crawlFirstByteTime");
+        if (firstByteTime.isValid())
+            m_metrics.bodyTime->observe(m_clock.elapsed() - firstByteTime.toLongLong());
+        m_urlExtractors[reply].feed(reply->readAll());
+        queueFoundUrls(reply);
     } else {
-        qWarning() << "got error while parsing" << currentUrl << "for" << originalUrl << reply->errorString();
+        qCWarning(lcCrawler, "event=body_error url=%s original_url=%s error=\"%s\"",
+                  qUtf8Printable(currentUrl.toString()), qUtf8Printable(originalUrl.toString()),
+                  qUtf8Printable(reply->errorString()));
     }
     finishRequest(reply);
 }
 
-UrlFinderRunnable::UrlFinderRunnable(const QByteArray &data, const QUrl &originalUrl, const QUrl &currentUrl) :
-        QObject(), QRunnable(), m_data(data), m_originalUrl(originalUrl), m_currentUrl(currentUrl),
-        m_regExp("(https://[a-z0-9.@:]+)", Qt::CaseInsensitive) {
-}
-
-void UrlFinderRunnable::run() {
+void QtSslCrawler::queueFoundUrls(QNetworkReply *reply) {
 
-    int pos = 0;
-    while ((pos = m_regExp.indexIn(m_data, pos)) != -1) {
-        QUrl newUrl(m_regExp.cap(1));
+    QUrl currentUrl = reply->url();
+    QUrl originalUrl = reply->request().attribute(QNetworkRequest::User).toUrl();
+    UrlExtractor &extractor = m_urlExtractors[reply];
+    extractor.finish();
+    foreach (const QByteArray &url, extractor.takeUrls()) {
+        QUrl newUrl(QString::fromLatin1(url));
         if (newUrl.isValid()
             && newUrl.host().contains('.') // filter out 'https://ssl'
             && newUrl.host() != QLatin1String("ssl.")
-            && newUrl.host() != m_originalUrl.host()
-            && newUrl != m_currentUrl) { // prevent endless loops
-            qDebug() << "runnable: found valid url" << newUrl << "at original url" << m_originalUrl;
-            emit foundUrl(newUrl, m_originalUrl);
+            && newUrl.host() != originalUrl.host()
+            && newUrl != currentUrl) { // prevent endless loops
+            qCDebug(lcCrawler, "event=url_found url=%s original_url=%s",
+                    qUtf8Printable(newUrl.toString()), qUtf8Printable(originalUrl.toString()));
+            m_metrics.urlsFound->increment();
+            QNetworkRequest request(newUrl);
+            request.setAttribute(QNetworkRequest::User, originalUrl);
+            queueRequestIfNew(request);
         }
-        pos += m_regExp.matchedLength();
     }
+    scheduleCheck();
 }
@@ -23,65 +23,218 @@
 #define QTSSLCRAWLER_H
 
 #include <QObject>
+#include <QCache>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QList>
 #include <QUrl>
 #include <QSslCertificate>
+#include <QMetaType>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QSet>
-#include <QQueue>
-#include <QRunnable>
+#include <QAbstractSocket>
+#include <QSharedPointer>
+
+#include "concurrencylimiter.h"
+#include "crawlfrontier.h"
+#include "domainsource.h"
+#include "urlextractor.h"
+#include "metrics.h"
+#include "retrypolicy.h"
+
+class QTimer;
+class QSslSocket;
+class CrawlCheckpoint;
+class HostResolver;
+class DeadlineScheduler;
+class RecrawlPlan;
+class RecrawlPlanner;
+
+struct CrawlResult
+{
+    QUrl originalUrl;
+    QUrl urlWithCertificate;
+    QList<QSslCertificate> certificateChain;
+};
+Q_DECLARE_METATYPE(CrawlResult)
+
+struct FoundUrl
+{
+    QUrl url;
+    QUrl originalUrl; // the site which linked to it
+};
+Q_DECLARE_METATYPE(FoundUrl)
 
 class QtSslCrawler : public QObject
 {
     Q_OBJECT
 public:
     explicit QtSslCrawler(QObject *parent = 0, int from = 0, int to = 0);
+    ~QtSslCrawler();
 
 signals:
     void crawlResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
                      const QList<QSslCertificate> &certificateChain);
     void crawlFinished();
+    // only emitted in shard mode, see setShard()
+    void crawlResults(const QList<CrawlResult> &results);
+    // all URLs for hosts of other shards found since the last batch
+    void foreignUrlsFound(const QList<FoundUrl> &urls);
+    void idle(int routedUrlsReceived);
 
 public:
     void setCrawlFrom(int from) { m_crawlFrom = from; }
     void setCrawlTo(int to) { m_crawlTo = to; }
+    // only crawl hosts with shardForHost(host, count) == index,
+    // URLs of other hosts are handed out via foreignUrlsFound()
+    void setShard(int index, int count);
+    // the number of requests in flight is adapted between these limits
+    void setConcurrencyLimits(int floor, int ceiling) { m_concurrencyLimiter.setLimits(floor, ceiling); }
+    int concurrencyWindow() const { return m_concurrencyLimiter.window(); }
+    // in probe mode https:// URLs are only connected to for the TLS handshake,
+    // no HTTP request is sent; http:// URLs are still fetched to find links
+    void setProbeMode(bool probeMode) { m_probeMode = probeMode; }
+    // bodies are scanned for links while they arrive; replies larger
+    // than this are aborted (0 means no limit)
+    void setMaxBodySize(qint64 bytes) { m_maxBodySize = bytes; }
+    // periodically save the crawl state to files starting with baseName,
+    // see CrawlCheckpoint; with resume, continue where that crawl stopped
+    void setCheckpoint(const QString &baseName, bool resume);
+    // how visited URLs are stored, see VisitedUrlSet;
+    // the Bloom filter parameters are only used for VisitedUrlSet::BloomFilterMode
+    void setVisitedUrlSetMode(VisitedUrlSet::Mode mode, qint64 bloomFilterCapacity = 10000000,
+                              double bloomFilterFalsePositiveRate = 0.001);
+
+    // hosts are resolved with up to maxConcurrentLookups DNS lookups before
+    // their requests get a connection slot; hosts that do not exist are
+    // remembered for negativeCacheTime seconds. 0 lookups disables this,
+    // then QNetworkAccessManager resolves while holding the slot.
+    void setHostResolution(int maxConcurrentLookups, int negativeCacheTime);
+    // deadlines for connecting, the TLS handshake and the whole request
+    // in msecs (0: none); timeouts are retried like other temporary errors
+    void setTimeouts(int connectTimeout, int handshakeTimeout, int totalTimeout);
+    // how often (and after how many msecs, doubling) failed requests are
+    // retried, if the kind of error makes it worth trying again
+    void setRetryPolicy(int maxRetries, int retryDelay);
+    // if https://[domain] has not connected after delay msecs, fetch
+    // http://[domain] at the same time, whichever gets a certificate first
+    // wins (0: only fall back after https:// failed)
+    void setFallbackDelay(int delay);
+    // instead of top-1m.csv, check the sites of the plan again, most urgent
+    // first, for at most timeBudget msecs (0: no limit). Only chains that
+    // differ from the plan are reported; links are not followed, so this
+    // is meant to be used with probe mode.
+    void setRecrawlPlan(const QSharedPointer<const RecrawlPlan> &plan, qint64 timeBudget);
+
+    static QNetworkRequest::Attribute s_tryCountAttribute;
 public slots:
     void start();
     void replyMetaDataChanged();
     void replyError(QNetworkReply::NetworkError error);
+    void replyReadyRead();
     void replyFinished();
-    void foundUrl(const QUrl &foundUrl, const QUrl &originalUrl);
-    void timeout();
+    void addRoutedUrls(const QList<FoundUrl> &urls);
+    void flushResults();
+
+private slots:
+    void replyEncrypted();
+    void probeConnected();
+    void probeEncrypted();
+    void probeError(QAbstractSocket::SocketError error);
+    void checkpointTick();
+    void hostsResolved();
+    void hostNotFound(const QNetworkRequest &request);
+    void deadlineExpired(QObject *attempt, int phase);
+    void retryDue();
 
 private:
     Q_INVOKABLE void checkForSendingMoreRequests();
-    void queueRequestIfNew(const QNetworkRequest &request);
+    // posts checkForSendingMoreRequests() unless it is pending already
+    void scheduleCheck();
+    void flushForeignUrls();
+    void queueRequestIfNew(const QNetworkRequest &request, bool first = false);
     void sendRequest(const QNetworkRequest &request);
     void finishRequest(QNetworkReply *reply);
+    void sendProbe(const QNetworkRequest &request);
+    void finishProbe(QSslSocket *socket);
+    void queueFoundUrls(QNetworkReply *reply);
+    void handleFailure(QObject *attempt, RetryPolicy::ErrorClass errorClass);
+    bool canFallBack(const QUrl &currentUrl, const QUrl &originalUrl) const;
+    void queueHttpFallback(const QUrl &currentUrl, const QUrl &originalUrl);
+    void startRacingFallback(QObject *attempt);
+    void cancelRacingFallback(const QUrl &httpsUrl);
+    QNetworkRequest attemptRequest(QObject *attempt) const;
+    void reportResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                      const QList<QSslCertificate> &certificateChain);
+    void deliverResult(const CrawlResult &result);
+    static QString hostCacheKey(const QUrl &url);
+    bool reportCachedResult(const QNetworkRequest &request);
+    void startCheckpointing();
+    void writeSnapshot();
+    void checkIfFinished();
+    void updateGauges();
+    bool countCompletion(QObject *attempt);
     QNetworkAccessManager *m_manager;
-    QSet<QUrl> m_visitedUrls;
-    QQueue<QNetworkRequest> m_requestsToSend;
-    QSet<QUrl> m_urlsWaitForFinished;
+    HostResolver *m_resolver;
+    int m_activeConnections;
+    DeadlineScheduler *m_deadlines;
+    RetryPolicy m_retryPolicy;
+    QTimer *m_retryTimer;
+    // http:// attempts started while https:// is still trying, 0 until sent
+    QHash<QUrl, QNetworkReply *> m_racingFallbacks;
+    QSet<QUrl> m_cancelledFallbacks; // lost the race before being sent
+    const CrawlMetrics &m_metrics;
+    qint64 m_reportedPending;
+    qint64 m_reportedResolving;
+    qint64 m_reportedConnections;
+    qint64 m_reportedVisited;
+    DomainSource m_domainSource;
+    bool m_domainSourceOpened;
+    RecrawlPlanner *m_recrawlPlanner;
+    SeedSource *m_seedSource; // one of the above
+    qint64 m_changedChains;
+    qint64 m_unchangedChains;
+    CrawlFrontier m_frontier;
     int m_crawlFrom;
     int m_crawlTo;
+    int m_shardIndex;
+    int m_shardCount;
+    int m_routedUrlsReceived;
+    bool m_finishReported;
+    bool m_checkScheduled;
+    QList<FoundUrl> m_foreignUrls;
+    QList<CrawlResult> m_resultBatch;
+    QTimer *m_resultBatchTimer;
+    ConcurrencyLimiter m_concurrencyLimiter;
+    int m_reportedConcurrencyWindow;
+    QElapsedTimer m_clock;
+    bool m_probeMode;
+    QHash<QSslSocket *, QNetworkRequest> m_probes;
+    qint64 m_maxBodySize;
+    // the site and root certificates we got, keyed by host:port, so we do
+    // not do the same handshake again when reaching a host through another
+    // URL; only the most recently used hosts are kept
+    class HostResult {
+    public:
+        QUrl urlWithCertificate;
+        QSslCertificate siteCertificate;
+        QSslCertificate rootCertificate; // null if the chain is only the site certificate
+    };
+    void cacheHostResult(const QUrl &urlWithCertificate, const QList<QSslCertificate> &certificateChain);
+    QCache<QString, HostResult> m_hostResults;
+    qint64 m_reportedHostCacheEntries;
+    qint64 m_hostCacheLookups;
+    qint64 m_hostCacheHits;
+    QHash<QNetworkReply *, UrlExtractor> m_urlExtractors;
+    CrawlCheckpoint *m_checkpoint;
+    bool m_resume;
+    QTimer *m_checkpointTimer;
+    qint64 m_lastSnapshotTime;
     static int s_concurrentRequests;
-    static QNetworkRequest::Attribute s_tryCountAttribute;
-};
-
-class UrlFinderRunnable : public QObject, public QRunnable
-{
-    Q_OBJECT
-public:
-    explicit UrlFinderRunnable(const QByteArray &data, const QUrl &originalUrl, const QUrl &currentUrl);
-    void run();
-signals:
-    void foundUrl(const QUrl &foundUrl, const QUrl &originalUrl);
-private:
-    const QByteArray m_data;
-    const QUrl m_originalUrl;
-    const QUrl m_currentUrl;
-    const QRegExp m_regExp;
+    static int s_resultBatchSize;
+    static int s_hostCacheSize;
+    static qint64 s_snapshotInterval;
 };
 
 #endif // QTSSLCRAWLER_H
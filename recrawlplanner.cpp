@@ -0,0 +1,248 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "recrawlplanner.h"
+#include "resultwriter.h"
+#include "sharding.h"
+#include "logging.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
+
+#include <algorithm>
+
+static qint64 earlierExpiry(qint64 a, qint64 b) {
+
+    if (a == 0)
+        return b;
+    if (b == 0)
+        return a;
+    return qMin(a, b);
+}
+
+// certificates about to expire are the most likely ones to have been
+// replaced, and sites that changed their chain before tend to do it again
+static double sitePriority(const RecrawlPlan::Site &site, qint64 now) {
+
+    double daysLeft = 0; // expiry unknown, better check it
+    if (site.expiryDate > 0)
+        daysLeft = qMax<qint64>(0, site.expiryDate - now) / (24.0 * 60 * 60 * 1000);
+    return (1.0 + site.changeCount) / (1.0 + daysLeft);
+}
+
+static bool hasHigherPriority(const RecrawlPlan::Site &a, const RecrawlPlan::Site &b) {
+
+    return a.priority > b.priority;
+}
+
+RecrawlPlan::RecrawlPlan()
+{
+}
+
+bool RecrawlPlan::load(const QStringList &fileNames) {
+
+    foreach (const QString &fileName, fileNames) {
+        if (!loadFile(fileName))
+            return false;
+    }
+    return true;
+}
+
+bool RecrawlPlan::loadFile(const QString &fileName) {
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCWarning(lcStorage, "event=recrawl_load_failed file=%s reason=open", qUtf8Printable(fileName));
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != BinaryResultWriter::s_magic
+            || version != BinaryResultWriter::s_version) {
+        qCWarning(lcStorage, "event=recrawl_load_failed file=%s reason=format", qUtf8Printable(fileName));
+        return false;
+    }
+
+    // certificate ids are only valid within one file
+    QVector<QByteArray> fingerprints;
+    QVector<qint64> expiryDates;
+    int siteRecords = 0;
+    while (!stream.atEnd()) {
+        quint8 type;
+        stream >> type;
+        if (type == 'C') {
+            qint32 id;
+            QByteArray fingerprint;
+            QString subjectCountry, issuerOrganization, issuerCountry;
+            qint64 expiryDate;
+            stream >> id >> fingerprint >> subjectCountry >> issuerOrganization >> issuerCountry
+                   >> expiryDate;
+            if (stream.status() != QDataStream::Ok || id < 0)
+                break;
+            if (id >= fingerprints.count()) {
+                fingerprints.resize(id + 1);
+                expiryDates.resize(id + 1);
+            }
+            fingerprints[id] = fingerprint;
+            expiryDates[id] = expiryDate;
+        } else if (type == 'S') {
+            QByteArray url, originalUrl;
+            QByteArray siteFingerprint;
+            QString subjectCountry, issuerOrganization, issuerCountry;
+            qint64 siteExpiryDate;
+            qint32 rootCertificate;
+            quint32 linkingUrlCount;
+            stream >> url >> siteFingerprint >> subjectCountry >> issuerOrganization >> issuerCountry
+                   >> siteExpiryDate >> rootCertificate >> linkingUrlCount;
+            for (quint32 a = 0; a < linkingUrlCount && stream.status() == QDataStream::Ok; a++) {
+                QByteArray linkingUrl;
+                stream >> linkingUrl;
+                if (a == 0)
+                    originalUrl = linkingUrl;
+            }
+            if (stream.status() != QDataStream::Ok)
+                break;
+            // without a root, the chain is only the site certificate
+            QByteArray rootFingerprint = siteFingerprint;
+            qint64 rootExpiryDate = 0;
+            if (rootCertificate >= 0) {
+                if (rootCertificate >= fingerprints.count())
+                    break;
+                rootFingerprint = fingerprints.at(rootCertificate);
+                rootExpiryDate = expiryDates.at(rootCertificate);
+            }
+            addSite(QUrl::fromEncoded(url), QUrl::fromEncoded(originalUrl), siteFingerprint,
+                    rootFingerprint, earlierExpiry(siteExpiryDate, rootExpiryDate));
+            siteRecords++;
+        } else if (type == 'L') {
+            // the site was found with its first linking URL already
+            QByteArray url, linkingUrl;
+            stream >> url >> linkingUrl;
+            if (stream.status() != QDataStream::Ok)
+                break;
+        } else {
+            stream.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+    }
+    // a streamed file might end in the middle of a record after a crash,
+    // everything before it is still good
+    if (stream.status() != QDataStream::Ok || !stream.atEnd())
+        qCWarning(lcStorage, "event=recrawl_file_truncated file=%s sites=%d",
+                  qUtf8Printable(fileName), siteRecords);
+    qCWarning(lcStorage, "event=recrawl_file_loaded file=%s version=%u sites=%d certificates=%d",
+              qUtf8Printable(fileName), version, siteRecords, fingerprints.count());
+    return true;
+}
+
+void RecrawlPlan::addSite(const QUrl &url, const QUrl &originalUrl, const QByteArray &siteFingerprint,
+                          const QByteArray &rootFingerprint, qint64 expiryDate) {
+
+    QHash<QUrl, int>::const_iterator it = m_siteIndexes.constFind(url);
+    if (it == m_siteIndexes.constEnd()) {
+        Site site;
+        site.url = url;
+        site.originalUrl = originalUrl.isEmpty() ? url : originalUrl;
+        site.siteFingerprint = siteFingerprint;
+        site.rootFingerprint = rootFingerprint;
+        site.expiryDate = expiryDate;
+        m_siteIndexes.insert(url, m_sites.count());
+        m_sites.append(site);
+        return;
+    }
+    // the site was in an earlier file
+    Site &site = m_sites[it.value()];
+    if (site.siteFingerprint != siteFingerprint || site.rootFingerprint != rootFingerprint) {
+        site.changeCount++;
+        site.siteFingerprint = siteFingerprint;
+        site.rootFingerprint = rootFingerprint;
+        site.expiryDate = expiryDate;
+    }
+}
+
+void RecrawlPlan::prioritize(qint64 now, int maxSites) {
+
+    int expiringSoon = 0;
+    int changedBefore = 0;
+    for (int a = 0; a < m_sites.count(); a++) {
+        Site &site = m_sites[a];
+        site.priority = sitePriority(site, now);
+        if (site.expiryDate > 0 && site.expiryDate - now < Q_INT64_C(30) * 24 * 60 * 60 * 1000)
+            expiringSoon++;
+        if (site.changeCount > 0)
+            changedBefore++;
+    }
+    int siteCount = m_sites.count();
+    if (maxSites > 0 && maxSites < m_sites.count()) {
+        // no need to sort the sites we will not check
+        std::partial_sort(m_sites.begin(), m_sites.begin() + maxSites, m_sites.end(), hasHigherPriority);
+        m_sites.resize(maxSites);
+    } else {
+        std::sort(m_sites.begin(), m_sites.end(), hasHigherPriority);
+    }
+    m_siteIndexes.clear();
+    m_siteIndexes.reserve(m_sites.count());
+    for (int a = 0; a < m_sites.count(); a++)
+        m_siteIndexes.insert(m_sites.at(a).url, a);
+    qCWarning(lcStorage, "event=recrawl_plan sites=%d planned=%d expiring_30d=%d changed_before=%d",
+              siteCount, m_sites.count(), expiringSoon, changedBefore);
+}
+
+bool RecrawlPlan::isUnchanged(const QUrl &url, const QList<QSslCertificate> &certificateChain) const {
+
+    QHash<QUrl, int>::const_iterator it = m_siteIndexes.constFind(url);
+    if (it == m_siteIndexes.constEnd() || certificateChain.isEmpty())
+        return false;
+    const Site &site = m_sites.at(it.value());
+    return certificateChain.first().digest(QCryptographicHash::Sha1).toHex() == site.siteFingerprint
+            && certificateChain.last().digest(QCryptographicHash::Sha1).toHex() == site.rootFingerprint;
+}
+
+RecrawlPlanner::RecrawlPlanner(const QSharedPointer<const RecrawlPlan> &plan) :
+    m_plan(plan),
+    m_position(0),
+    m_shardIndex(0),
+    m_shardCount(1),
+    m_timeBudget(0)
+{
+}
+
+bool RecrawlPlanner::atEnd() const {
+
+    if (m_position >= m_plan->sites().count())
+        return true;
+    return (m_timeBudget > 0 && m_clock.isValid() && m_clock.elapsed() >= m_timeBudget);
+}
+
+QNetworkRequest RecrawlPlanner::nextRequest() {
+
+    if (!m_clock.isValid())
+        m_clock.start();
+    const RecrawlPlan::Site &site = m_plan->sites().at(int(m_position++));
+    if (shardForHost(site.url.host(), m_shardCount) != m_shardIndex)
+        return QNetworkRequest();
+    QNetworkRequest request(site.url);
+    request.setAttribute(QNetworkRequest::User, site.originalUrl);
+    return request;
+}
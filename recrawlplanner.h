@@ -0,0 +1,105 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef RECRAWLPLANNER_H
+#define RECRAWLPLANNER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QSslCertificate>
+#include <QStringList>
+#include <QUrl>
+#include <QVector>
+
+#include "seedsource.h"
+
+// the sites found by earlier crawls, in the order they should be checked again.
+// Loaded from results in binary format (see BinaryResultWriter), oldest first:
+// usually one full crawl followed by the outputs of the re-crawls since then,
+// which only contain the chains that changed.
+// The plan is not modified after prioritize(), so the crawlers of a
+// CrawlerPool can share it.
+class RecrawlPlan
+{
+public:
+    class Site {
+    public:
+        Site() : expiryDate(0), changeCount(0), priority(0) { }
+        QUrl url; // where the certificate was found
+        QUrl originalUrl; // the first URL linking to it
+        QByteArray siteFingerprint; // SHA-1, hex encoded, as in CertificateTable
+        QByteArray rootFingerprint;
+        qint64 expiryDate; // the earlier one of both certificates, 0 if unknown
+        int changeCount; // how often the chain changed from one file to the next
+        double priority;
+    };
+
+    RecrawlPlan();
+
+    bool load(const QStringList &fileNames);
+    // orders the sites by priority, most urgent first,
+    // and keeps at most maxSites of them (0: all)
+    void prioritize(qint64 now, int maxSites);
+    const QVector<Site> &sites() const { return m_sites; }
+    // false for sites not in the plan
+    bool isUnchanged(const QUrl &url, const QList<QSslCertificate> &certificateChain) const;
+
+private:
+    bool loadFile(const QString &fileName);
+    void addSite(const QUrl &url, const QUrl &originalUrl, const QByteArray &siteFingerprint,
+                 const QByteArray &rootFingerprint, qint64 expiryDate);
+
+    QVector<Site> m_sites;
+    QHash<QUrl, int> m_siteIndexes; // into m_sites
+};
+
+// hands out the sites of a plan as seeds until all of them have been
+// handed out or the time budget is used up
+class RecrawlPlanner : public SeedSource
+{
+public:
+    explicit RecrawlPlanner(const QSharedPointer<const RecrawlPlan> &plan);
+
+    void setShard(int index, int count) { m_shardIndex = index; m_shardCount = count; }
+    // msecs from handing out the first seed, 0 means no limit;
+    // requests in flight when it is over are still finished
+    void setTimeBudget(qint64 msecs) { m_timeBudget = msecs; }
+    const RecrawlPlan &plan() const { return *m_plan; }
+
+    bool atEnd() const;
+    QNetworkRequest nextRequest();
+    int currentLine() const { return int(m_position) + 1; }
+    qint64 position() const { return m_position; }
+    void restorePosition(qint64 position, int line) { Q_UNUSED(line); m_position = position; }
+
+private:
+    QSharedPointer<const RecrawlPlan> m_plan;
+    qint64 m_position; // index into the sites of the plan
+    int m_shardIndex;
+    int m_shardCount;
+    qint64 m_timeBudget;
+    QElapsedTimer m_clock;
+};
+
+#endif // RECRAWLPLANNER_H
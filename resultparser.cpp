@@ -20,61 +20,259 @@
 *************************************************************************************/
 
 #include "resultparser.h"
+#include "aggregates.h"
+#include "logging.h"
+#include "metrics.h"
 
-#include <QDebug>
 #include <QStringList>
+#include <QThread>
+#include <QTimer>
 
-ResultParser::ResultParser(QtSslCrawler *crawler) :
+#include <stdio.h>
+
+// a few seconds of results at full speed
+const int ResultParser::s_queueCapacity = 16384;
+const int ResultConsumer::s_summaryTopCount = 50;
+
+ResultParser::ResultParser(QObject *crawler, const QString &outputFileName,
+                           ResultWriter::Format format, Mode mode) :
     QObject(crawler),
     m_crawler(crawler),
-    m_outStream(stdout, QIODevice::WriteOnly)
+    m_queue(s_queueCapacity),
+    m_wakeupPending(0),
+    m_thread(new QThread(this)),
+    m_consumer(new ResultConsumer(&m_queue, &m_wakeupPending, outputFileName, format, mode)),
+    m_queueDepth(CrawlMetrics::instance().resultQueueDepth),
+    m_queueFull(CrawlMetrics::instance().resultQueueFull)
 {
+    m_consumer->moveToThread(m_thread);
+    connect(m_thread, SIGNAL(finished()), m_consumer, SLOT(deleteLater()));
+    connect(m_consumer, SIGNAL(finished()), this, SIGNAL(parsingDone()));
+    // the results are only queued in the crawler's thread, so the handshakes
+    // of the other replies are not delayed by parsing
     connect(m_crawler, SIGNAL(crawlResult(QUrl,QUrl,QList<QSslCertificate>)),
-            this, SLOT(parseResult(QUrl,QUrl,QList<QSslCertificate>)));
+            this, SLOT(parseResult(QUrl,QUrl,QList<QSslCertificate>)), Qt::DirectConnection);
     connect(m_crawler, SIGNAL(crawlFinished()), this, SLOT(parseAllResults()));
-    m_outStream << "URL containing certificate;site certificate country;root cert organization;" <<
-            "root certificate country;linking URLs\n";
+    m_thread->start();
+    QMetaObject::invokeMethod(m_consumer, "start", Qt::QueuedConnection);
+}
+
+ResultParser::~ResultParser() {
+
+    m_thread->quit();
+    m_thread->wait();
+}
+
+void ResultParser::setSummaryInterval(int interval) {
+
+    QMetaObject::invokeMethod(m_consumer, "startSummaryTimer", Qt::QueuedConnection,
+                              Q_ARG(int, interval));
+}
+
+void ResultParser::logSummary() {
+
+    QMetaObject::invokeMethod(m_consumer, "logSummary", Qt::QueuedConnection);
+}
+
+void ResultParser::wakeConsumer() {
+
+    // one pending call drains everything queued until it runs
+    if (m_wakeupPending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(m_consumer, "drain", Qt::QueuedConnection);
 }
 
 void ResultParser::parseResult(const QUrl &originalUrl,
                           const QUrl &urlWithCertificate,
                           const QList<QSslCertificate> &certificateChain) {
-    Result currentResult = m_results.value(urlWithCertificate);
+    ResultRecord record;
+    record.originalUrl = originalUrl;
+    record.urlWithCertificate = urlWithCertificate;
+    record.siteCertificate = certificateChain.first();
+    if (certificateChain.count() > 1)
+        record.rootCertificate = certificateChain.last();
+    if (!m_queue.tryPush(record)) {
+        // the parser cannot keep up: blocking the crawler's thread until
+        // drain() made space keeps it from sending more requests
+        m_queueFull->increment();
+        wakeConsumer();
+        m_queue.push(record);
+    }
+    m_queueDepth->add(1);
+    wakeConsumer();
+}
 
-    if (currentResult.sitesContainingLink.empty()) { // first time we encounter this site
-        QSslCertificate lastCertInChain = certificateChain.last();
-        currentResult.siteCertCountry = certificateChain.first().subjectInfo(QSslCertificate::CountryName).join(" / ");
-        currentResult.rootCertCountry = lastCertInChain.issuerInfo(QSslCertificate::CountryName).join(" / ");
-        currentResult.rootCertOrganization =
-                lastCertInChain.issuerInfo(QSslCertificate::Organization).join(" / ");
+void ResultParser::parseAllResults()
+{
+    // everything this thread pushed is in the queue before the call is queued
+    QMetaObject::invokeMethod(m_consumer, "finish", Qt::QueuedConnection);
+}
+
+
+ResultConsumer::ResultConsumer(ResultQueue *queue, QAtomicInt *wakeupPending,
+                               const QString &outputFileName, ResultWriter::Format format,
+                               ResultParser::Mode mode) :
+    QObject(),
+    m_queue(queue),
+    m_wakeupPending(wakeupPending),
+    m_queueDepth(CrawlMetrics::instance().resultQueueDepth),
+    m_writer(0),
+    m_mode(mode),
+    m_streamedResults(0),
+    m_streamedSites(VisitedUrlSet::FingerprintMode),
+    m_flushTimer(0),
+    m_aggregates(0),
+    m_summaryTimer(0)
+{
+    // the output is opened here so that failing to do so stops
+    // the crawl before it starts
+    if (m_mode == ResultParser::AggregateMode) {
+        // the summary is plain text, the output format does not apply
+        m_aggregates = new CrawlAggregates;
+        bool opened;
+        if (outputFileName.isEmpty()) {
+            opened = m_summaryFile.open(stdout, QIODevice::WriteOnly);
+        } else {
+            m_summaryFile.setFileName(outputFileName);
+            opened = m_summaryFile.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        }
+        if (!opened) {
+            qFatal("could not open output file '%s'", qPrintable(outputFileName));
+        }
+    } else {
+        m_writer = ResultWriter::create(format, m_certificates);
+        if (!m_writer->open(outputFileName)) {
+            qFatal("could not open output file '%s'", qPrintable(outputFileName));
+        }
+    }
+}
+
+ResultConsumer::~ResultConsumer() {
+
+    delete m_writer;
+    delete m_aggregates;
+}
+
+void ResultConsumer::start() {
+
+    if (m_mode == ResultParser::StreamMode) {
+        // a crash loses at most the last few seconds of results
+        m_flushTimer = new QTimer(this);
+        connect(m_flushTimer, SIGNAL(timeout()), this, SLOT(flushOutput()));
+        m_flushTimer->start(5000);
+    }
+}
+
+void ResultConsumer::startSummaryTimer(int interval) {
+
+    if (m_mode != ResultParser::AggregateMode || interval <= 0)
+        return;
+    m_summaryTimer = new QTimer(this);
+    connect(m_summaryTimer, SIGNAL(timeout()), this, SLOT(logSummary()));
+    m_summaryTimer->start(interval);
+}
+
+void ResultConsumer::logSummary() {
+
+    if (m_aggregates)
+        qCWarning(lcStorage).noquote() << "event=aggregates\n" + QString::fromUtf8(m_aggregates->summary(10));
+}
+
+void ResultConsumer::flushOutput() {
+
+    m_writer->flush();
+}
+
+void ResultConsumer::drain() {
+
+    // cleared before popping, so a result pushed after the last pop
+    // queues another call
+    m_wakeupPending->fetchAndStoreOrdered(0);
+    ResultRecord record;
+    qint64 count = 0;
+    while (m_queue->tryPop(&record)) {
+        parseResult(record);
+        count++;
+    }
+    if (count > 0)
+        m_queue->wakeProducers();
+    m_queueDepth->add(-count);
+}
+
+void ResultConsumer::parseResult(const ResultRecord &record) {
+
+    if (m_mode == ResultParser::AggregateMode) {
+        // nothing is interned, the fields are read from the certificates
+        // directly so memory stays fixed whatever the chains look like
+        const QSslCertificate &root = record.rootCertificate.isNull()
+                ? record.siteCertificate : record.rootCertificate;
+        m_aggregates->addResult(record.originalUrl, record.urlWithCertificate,
+                                root.issuerInfo(QSslCertificate::Organization).join(" / "),
+                                record.siteCertificate.subjectInfo(QSslCertificate::CountryName).join(" / "));
+        return;
     }
-    if (!currentResult.sitesContainingLink.contains(originalUrl)) {
-        currentResult.sitesContainingLink.insert(originalUrl);
-        m_results.insert(urlWithCertificate, currentResult);
+    if (m_mode == ResultParser::StreamMode) {
+        // only the roots are interned, there are few of them, and the
+        // sites written are only remembered by fingerprint, so memory
+        // grows by a few bytes per site
+        m_streamedResults++;
+        if (m_streamedSites.contains(record.urlWithCertificate)) {
+            m_writer->writeLink(record.urlWithCertificate, record.originalUrl);
+            return;
+        }
+        m_streamedSites.insert(record.urlWithCertificate);
+        bool hasRoot = !record.rootCertificate.isNull();
+        m_writer->writeSite(record.urlWithCertificate,
+                            CertificateTable::describe(record.siteCertificate, !hasRoot),
+                            hasRoot ? m_certificates.intern(record.rootCertificate) : -1,
+                            QList<QUrl>() << record.originalUrl);
+        return;
     }
+
+    // updated in place, the set of linking sites is not copied
+    Result &currentResult = m_results[record.urlWithCertificate];
+
+    if (currentResult.sitesContainingLink.empty()) { // first time we encounter this site
+        bool hasRoot = !record.rootCertificate.isNull();
+        currentResult.siteCertificate = CertificateTable::describe(record.siteCertificate, !hasRoot);
+        if (hasRoot)
+            currentResult.rootCertificate = m_certificates.intern(record.rootCertificate);
+    }
+    currentResult.sitesContainingLink.insert(record.originalUrl);
 }
 
-void ResultParser::parseAllResults()
+void ResultConsumer::finish()
 {
+    drain();
+    if (m_mode == ResultParser::AggregateMode) {
+        if (m_summaryTimer)
+            m_summaryTimer->stop();
+        m_summaryFile.write(m_aggregates->summary(s_summaryTopCount));
+        m_summaryFile.flush();
+        qCWarning(lcStorage, "event=summary_written results=%lld", m_aggregates->resultCount());
+        emit finished();
+        return;
+    }
+    if (m_mode == ResultParser::StreamMode) {
+        if (m_flushTimer)
+            m_flushTimer->stop();
+        qCWarning(lcStorage, "event=results_written results=%lld sites=%lld root_certificates=%d",
+                  m_streamedResults, m_streamedSites.count(), m_certificates.count());
+        m_writer->flush();
+        emit finished();
+        return;
+    }
+
     QHashIterator<QUrl, Result> resultIterator(m_results);
     qint32 totalCount = 0;
     while (resultIterator.hasNext()) {
         resultIterator.next();
-        QUrl urlWithCertificate = resultIterator.key();
-        Result currentResult = resultIterator.value();
-        m_outStream << urlWithCertificate.toString() << ";"
-                << currentResult.siteCertCountry << ";"
-                << currentResult.rootCertOrganization << ";"
-                << currentResult.rootCertCountry;
-        QSet<QUrl> urls = currentResult.sitesContainingLink;
-        QSetIterator<QUrl> urlIterator(urls);
-        while(urlIterator.hasNext()) {
-            m_outStream << ";" << urlIterator.next().toString();
-        }
+        const Result &currentResult = resultIterator.value();
+        m_writer->writeSite(resultIterator.key(), currentResult.siteCertificate,
+                            currentResult.rootCertificate, currentResult.sitesContainingLink.values());
         totalCount++;
-        m_outStream << "\n";
     }
-    qWarning() << "in total found" << totalCount << "certificates";
-    m_outStream.flush();
-    emit parsingDone();
+    qCWarning(lcStorage, "event=results_written sites=%d root_certificates=%d",
+              totalCount, m_certificates.count());
+    m_writer->flush();
+    emit finished();
 }
@@ -22,40 +22,126 @@
 #ifndef RESULTPARSER_H
 #define RESULTPARSER_H
 
-#include "qt-ssl-crawler.h"
-
+#include <QAtomicInt>
 #include <QObject>
+#include <QFile>
 #include <QHash>
 #include <QSet>
-#include <QTextStream>
+#include <QUrl>
+#include <QSslCertificate>
+
+#include "certificatetable.h"
+#include "resultqueue.h"
+#include "resultwriter.h"
+#include "visitedurlset.h"
+
+class QThread;
+class QTimer;
+class CrawlAggregates;
+class MetricCounter;
+class MetricGauge;
+class ResultConsumer;
 
 class ResultParser : public QObject
 {
     Q_OBJECT
 public:
-    explicit ResultParser(QtSslCrawler *crawler);
+    enum Mode {
+        CollectMode,
+        // results are not collected but written as soon as they arrive:
+        // a site when it is first found, then only its further linking
+        // URLs (see ResultWriter::writeLink()); flushed periodically
+        StreamMode,
+        // only counts per root CA and country and the most linked sites
+        // are kept (see CrawlAggregates) and written as a summary at the end
+        AggregateMode
+    };
+
+    // crawler is a QtSslCrawler or a CrawlerPool; the results are parsed
+    // in a thread of their own, so the crawler's thread only queues them
+    explicit ResultParser(QObject *crawler, const QString &outputFileName = QString(),
+                          ResultWriter::Format format = ResultWriter::CsvFormat,
+                          Mode mode = CollectMode);
+    ~ResultParser();
+
+    // in aggregate mode, log the summary every interval msecs while crawling
+    void setSummaryInterval(int interval);
 
 signals:
     void parsingDone();
 
 public slots:
+    // called in the crawler's thread; waits while the queue is full
     void parseResult(const QUrl &originalUrl, const QUrl &urlWithCertificate,
                      const QList<QSslCertificate> &certificateChain);
     void parseAllResults();
+    void logSummary();
+
+private:
+    void wakeConsumer();
+
+    static const int s_queueCapacity;
+    QObject *m_crawler;
+    ResultQueue m_queue;
+    // set while a call to drain the queue is pending in the consumer thread
+    QAtomicInt m_wakeupPending;
+    QThread *m_thread;
+    ResultConsumer *m_consumer;
+    MetricGauge *m_queueDepth;
+    MetricCounter *m_queueFull;
+};
+
+
+// does the actual work of the ResultParser in the parser thread
+class ResultConsumer : public QObject
+{
+    Q_OBJECT
+public:
+    ResultConsumer(ResultQueue *queue, QAtomicInt *wakeupPending, const QString &outputFileName,
+                   ResultWriter::Format format, ResultParser::Mode mode);
+    ~ResultConsumer();
+
+signals:
+    void finished();
+
+public slots:
+    void start();
+    void drain();
+    void finish();
+    void startSummaryTimer(int interval);
+    void logSummary();
+
+private slots:
+    void flushOutput();
 
 private:
     class Result {
     public:
-        Result() { }
-        QString siteCertCountry;
-        QString rootCertOrganization;
-        QString rootCertCountry;
+        Result() : rootCertificate(-1) { }
+        // nearly every site has its own certificate, so it is kept here
+        // instead of in m_certificates
+        CertificateTable::Certificate siteCertificate;
+        int rootCertificate; // index into m_certificates, -1 without a root
         QSet<QUrl> sitesContainingLink;
     };
 
-    QtSslCrawler *m_crawler;
+    void parseResult(const ResultRecord &record);
+
+    ResultQueue *m_queue;
+    QAtomicInt *m_wakeupPending;
+    MetricGauge *m_queueDepth;
+    CertificateTable m_certificates;
     QHash<QUrl, Result> m_results;
-    QTextStream m_outStream;
+    ResultWriter *m_writer;
+    ResultParser::Mode m_mode;
+    qint64 m_streamedResults;
+    // the sites written when streaming, later results only add a link
+    VisitedUrlSet m_streamedSites;
+    QTimer *m_flushTimer;
+    CrawlAggregates *m_aggregates;
+    QFile m_summaryFile;
+    QTimer *m_summaryTimer;
+    static const int s_summaryTopCount;
 };
 
 #endif // RESULTPARSER_H
@@ -0,0 +1,100 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "resultqueue.h"
+
+ResultQueue::ResultQueue(int capacity) :
+    m_pushPosition(0),
+    m_popPosition(0),
+    m_blockedProducers(0)
+{
+    quint32 size = 2;
+    while (size < quint32(capacity) && size < (1u << 30))
+        size *= 2;
+    m_mask = size - 1;
+    m_slots = new Slot[size];
+    for (quint32 a = 0; a < size; a++)
+        m_slots[a].sequence.store(a);
+}
+
+ResultQueue::~ResultQueue() {
+
+    delete[] m_slots;
+}
+
+bool ResultQueue::tryPush(const ResultRecord &record) {
+
+    Slot *slot;
+    quint32 position = m_pushPosition.loadAcquire();
+    forever {
+        slot = &m_slots[position & m_mask];
+        // the positions wrap around, so only their difference counts
+        qint32 difference = qint32(slot->sequence.loadAcquire() - position);
+        if (difference == 0) {
+            // the slot is free, claim it unless another producer was faster
+            if (m_pushPosition.testAndSetOrdered(position, position + 1, position))
+                break;
+        } else if (difference < 0) {
+            // the consumer has not popped the record from one round before
+            return false;
+        } else {
+            position = m_pushPosition.loadAcquire();
+        }
+    }
+    slot->record = record;
+    slot->sequence.storeRelease(position + 1);
+    return true;
+}
+
+void ResultQueue::push(const ResultRecord &record) {
+
+    if (tryPush(record))
+        return;
+    QMutexLocker locker(&m_spaceMutex);
+    // a read-modify-write like the one in wakeProducers(), so either the
+    // consumer sees us blocked or we see the slot it freed
+    m_blockedProducers.fetchAndAddOrdered(1);
+    while (!tryPush(record))
+        m_spaceAvailable.wait(&m_spaceMutex);
+    m_blockedProducers.fetchAndAddOrdered(-1);
+}
+
+bool ResultQueue::tryPop(ResultRecord *record) {
+
+    Slot &slot = m_slots[m_popPosition & m_mask];
+    if (qint32(slot.sequence.loadAcquire() - (m_popPosition + 1)) < 0)
+        return false;
+    *record = slot.record;
+    // do not keep the URLs and certificates alive until the slot is reused
+    slot.record = ResultRecord();
+    slot.sequence.storeRelease(m_popPosition + m_mask + 1);
+    m_popPosition++;
+    return true;
+}
+
+void ResultQueue::wakeProducers() {
+
+    if (m_blockedProducers.fetchAndAddOrdered(0) == 0)
+        return;
+    // the producers wait with the mutex released, so no wakeup is lost
+    QMutexLocker locker(&m_spaceMutex);
+    m_spaceAvailable.wakeAll();
+}
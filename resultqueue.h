@@ -0,0 +1,86 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef RESULTQUEUE_H
+#define RESULTQUEUE_H
+
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSslCertificate>
+#include <QUrl>
+
+// what the parser needs of a crawl result: the chain itself is not
+// kept, only the site and root certificates; the root is null if the
+// chain is only the site certificate
+class ResultRecord {
+public:
+    QUrl originalUrl;
+    QUrl urlWithCertificate;
+    QSslCertificate siteCertificate;
+    QSslCertificate rootCertificate;
+};
+
+// a bounded queue that any number of threads can push to and one thread
+// pops from, without locks: every slot has a sequence number that tells
+// whether it is free for the producer at that position or filled for the
+// consumer (see Dmitry Vyukov's bounded MPMC queue)
+class ResultQueue
+{
+public:
+    // capacity is rounded up to a power of two
+    explicit ResultQueue(int capacity);
+    ~ResultQueue();
+
+    // returns false if the queue is full
+    bool tryPush(const ResultRecord &record);
+    // blocks while the queue is full, until the consumer calls wakeProducers()
+    void push(const ResultRecord &record);
+    // returns false if the queue is empty; only one thread may pop
+    bool tryPop(ResultRecord *record);
+    // wakes the producers blocked in push(), call it after popping
+    void wakeProducers();
+
+    int capacity() const { return int(m_mask + 1); }
+
+private:
+    Q_DISABLE_COPY(ResultQueue)
+
+    class Slot {
+    public:
+        QAtomicInteger<quint32> sequence;
+        ResultRecord record;
+    };
+
+    Slot *m_slots;
+    quint32 m_mask;
+    // producers and the consumer should not share a cache line
+    char m_padding1[64];
+    QAtomicInteger<quint32> m_pushPosition;
+    char m_padding2[64];
+    quint32 m_popPosition;
+    // only used when the queue is full
+    QAtomicInt m_blockedProducers;
+    QMutex m_spaceMutex;
+    QWaitCondition m_spaceAvailable;
+};
+
+#endif // RESULTQUEUE_H
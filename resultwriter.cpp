@@ -0,0 +1,149 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "resultwriter.h"
+
+#include <stdio.h>
+
+const quint32 BinaryResultWriter::s_magic = 0x51534352; // "QSCR"
+const quint32 BinaryResultWriter::s_version = 1;
+
+ResultWriter *ResultWriter::create(Format format, const CertificateTable &certificates) {
+
+    if (format == BinaryFormat)
+        return new BinaryResultWriter(certificates);
+    return new CsvResultWriter(certificates);
+}
+
+ResultWriter::ResultWriter(const CertificateTable &certificates) :
+    m_certificates(certificates)
+{
+}
+
+ResultWriter::~ResultWriter() {
+
+    // m_file flushes its buffer when it is closed, the streams of the
+    // subclasses are flushed by their destructors
+}
+
+bool ResultWriter::open(const QString &fileName) {
+
+    bool opened;
+    if (fileName.isEmpty()) {
+        opened = m_file.open(stdout, QIODevice::WriteOnly);
+    } else {
+        m_file.setFileName(fileName);
+        opened = m_file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+    if (opened)
+        writeHeader();
+    return opened;
+}
+
+void ResultWriter::flush() {
+
+    if (m_file.isOpen())
+        m_file.flush();
+}
+
+CsvResultWriter::CsvResultWriter(const CertificateTable &certificates) :
+    ResultWriter(certificates),
+    m_stream(&m_file)
+{
+}
+
+CsvResultWriter::~CsvResultWriter() {
+
+    m_stream.flush(); // before the file is closed in ~ResultWriter()
+}
+
+void CsvResultWriter::writeHeader() {
+
+    m_stream << "URL containing certificate;site certificate country;root cert organization;" <<
+            "root certificate country;linking URLs\n";
+}
+
+void CsvResultWriter::writeSite(const QUrl &url, const CertificateTable::Certificate &siteCertificate,
+                                int rootCertificate, const QList<QUrl> &linkingUrls) {
+
+    const CertificateTable::Certificate &root = rootCertificate < 0
+            ? siteCertificate : m_certificates.certificate(rootCertificate);
+    m_stream << url.toString() << ";"
+            << siteCertificate.subjectCountry << ";"
+            << root.issuerOrganization << ";"
+            << root.issuerCountry;
+    foreach (const QUrl &linkingUrl, linkingUrls)
+        m_stream << ";" << linkingUrl.toString();
+    m_stream << "\n";
+}
+
+void CsvResultWriter::writeLink(const QUrl &url, const QUrl &linkingUrl) {
+
+    m_stream << url.toString() << ";;;;" << linkingUrl.toString() << "\n";
+}
+
+void CsvResultWriter::flush() {
+
+    m_stream.flush(); // QTextStream has its own buffer in front of the file
+    ResultWriter::flush();
+}
+
+BinaryResultWriter::BinaryResultWriter(const CertificateTable &certificates) :
+    ResultWriter(certificates),
+    m_stream(&m_file)
+{
+    m_stream.setVersion(QDataStream::Qt_5_0);
+}
+
+void BinaryResultWriter::writeHeader() {
+
+    m_stream << s_magic << s_version;
+}
+
+void BinaryResultWriter::writeSite(const QUrl &url, const CertificateTable::Certificate &siteCertificate,
+                                   int rootCertificate, const QList<QUrl> &linkingUrls) {
+
+    if (rootCertificate >= 0)
+        writeCertificateIfNew(rootCertificate);
+    m_stream << quint8('S') << url.toEncoded() << siteCertificate.fingerprint.toHex()
+             << siteCertificate.subjectCountry << siteCertificate.issuerOrganization
+             << siteCertificate.issuerCountry << siteCertificate.expiryDate
+             << qint32(rootCertificate) << quint32(linkingUrls.count());
+    foreach (const QUrl &linkingUrl, linkingUrls)
+        m_stream << linkingUrl.toEncoded();
+}
+
+void BinaryResultWriter::writeLink(const QUrl &url, const QUrl &linkingUrl) {
+
+    m_stream << quint8('L') << url.toEncoded() << linkingUrl.toEncoded();
+}
+
+void BinaryResultWriter::writeCertificateIfNew(int id) {
+
+    if (id < m_writtenCertificates.count() && m_writtenCertificates.at(id))
+        return;
+    if (id >= m_writtenCertificates.count())
+        m_writtenCertificates.resize(id + 1);
+    m_writtenCertificates[id] = true;
+    const CertificateTable::Certificate &certificate = m_certificates.certificate(id);
+    m_stream << quint8('C') << qint32(id) << certificate.fingerprint.toHex() << certificate.subjectCountry
+             << certificate.issuerOrganization << certificate.issuerCountry << certificate.expiryDate;
+}
@@ -0,0 +1,121 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include <QFile>
+#include <QTextStream>
+#include <QDataStream>
+#include <QList>
+#include <QUrl>
+#include <QVector>
+
+#include "certificatetable.h"
+
+// writes results to a file or stdout; writes are buffered by QFile
+// and only hit the disk when the buffer is full or on flush()
+class ResultWriter
+{
+public:
+    enum Format {
+        CsvFormat,
+        BinaryFormat
+    };
+
+    static ResultWriter *create(Format format, const CertificateTable &certificates);
+    virtual ~ResultWriter();
+
+    // an empty file name means stdout
+    bool open(const QString &fileName);
+    // rootCertificate is -1 if the chain is only the site certificate,
+    // the root columns then show the issuer of the site certificate
+    virtual void writeSite(const QUrl &url, const CertificateTable::Certificate &siteCertificate,
+                           int rootCertificate, const QList<QUrl> &linkingUrls) = 0;
+    // when streaming, a site is written once with the first URL linking
+    // to it, the URLs found linking to it later are written with this
+    virtual void writeLink(const QUrl &url, const QUrl &linkingUrl) = 0;
+    virtual void flush();
+
+protected:
+    explicit ResultWriter(const CertificateTable &certificates);
+    virtual void writeHeader() = 0;
+
+    const CertificateTable &m_certificates;
+    QFile m_file;
+};
+
+// the format ResultParser has always written:
+// URL;site cert country;root cert organization;root cert country;linking URL;...
+// further linking URLs of a streamed site leave the certificate columns empty
+class CsvResultWriter : public ResultWriter
+{
+public:
+    explicit CsvResultWriter(const CertificateTable &certificates);
+    ~CsvResultWriter();
+    void writeSite(const QUrl &url, const CertificateTable::Certificate &siteCertificate,
+                   int rootCertificate, const QList<QUrl> &linkingUrls);
+    void writeLink(const QUrl &url, const QUrl &linkingUrl);
+    void flush();
+
+protected:
+    void writeHeader();
+
+private:
+    QTextStream m_stream;
+};
+
+// compact binary format, written with QDataStream (Qt_5_0, big endian):
+// header: quint32 magic 'QSCR', quint32 version
+// then records starting with a quint8 type:
+//   'C': a root certificate, written before the first site referencing it:
+//        qint32 id, QByteArray SHA-1 fingerprint (hex), QString subject country,
+//        QString issuer organization, QString issuer country,
+//        qint64 expiry date in msecs since epoch, 0 if unknown
+//   'S': QByteArray encoded URL, the site certificate (QByteArray fingerprint,
+//        QString subject country, QString issuer organization, QString issuer
+//        country, qint64 expiry date; the issuer is only set without a root),
+//        qint32 root certificate id or -1 if the chain is only the site certificate,
+//        quint32 number of linking URLs, followed by that many QByteArray encoded URLs
+//   'L': QByteArray encoded URL of a site written before, QByteArray encoded URL
+//        linking to it (only when streaming)
+class BinaryResultWriter : public ResultWriter
+{
+public:
+    explicit BinaryResultWriter(const CertificateTable &certificates);
+    void writeSite(const QUrl &url, const CertificateTable::Certificate &siteCertificate,
+                   int rootCertificate, const QList<QUrl> &linkingUrls);
+    void writeLink(const QUrl &url, const QUrl &linkingUrl);
+
+    static const quint32 s_magic;
+    static const quint32 s_version;
+
+protected:
+    void writeHeader();
+
+private:
+    void writeCertificateIfNew(int id);
+
+    QDataStream m_stream;
+    QVector<bool> m_writtenCertificates;
+};
+
+#endif // RESULTWRITER_H
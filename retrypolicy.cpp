@@ -0,0 +1,146 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "retrypolicy.h"
+
+#include <QAtomicInteger>
+#include <QCoreApplication>
+#include <QDateTime>
+
+const int RetryPolicy::s_maxRetryDelay = 5 * 60 * 1000;
+
+static QBasicAtomicInteger<quint32> policyCount = Q_BASIC_ATOMIC_INITIALIZER(0);
+
+RetryPolicy::RetryPolicy(int maxRetries, int retryDelay) :
+    m_maxRetries(maxRetries),
+    m_retryDelay(retryDelay)
+{
+    // different for every policy in this process and for every process
+    // started at the same time
+    m_randomState = quint64(QDateTime::currentMSecsSinceEpoch())
+            ^ (quint64(QCoreApplication::applicationPid()) << 20)
+            ^ (quint64(policyCount.fetchAndAddRelaxed(1)) << 48);
+}
+
+RetryPolicy::ErrorClass RetryPolicy::classify(QNetworkReply::NetworkError error) {
+
+    switch (error) {
+    case QNetworkReply::HostNotFoundError:
+        return HostError;
+    case QNetworkReply::ConnectionRefusedError:
+        return RefusedError;
+    case QNetworkReply::SslHandshakeFailedError:
+        return TlsError;
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::ProxyTimeoutError:
+        return TransientError;
+    case QNetworkReply::InternalServerError:
+    case QNetworkReply::ServiceUnavailableError:
+    case QNetworkReply::UnknownServerError:
+        return ServerError;
+    case QNetworkReply::ContentAccessDenied:
+    case QNetworkReply::ContentOperationNotPermittedError:
+    case QNetworkReply::ContentNotFoundError:
+    case QNetworkReply::AuthenticationRequiredError:
+    case QNetworkReply::ContentReSendError:
+    case QNetworkReply::ContentConflictError:
+    case QNetworkReply::ContentGoneError:
+    case QNetworkReply::UnknownContentError:
+    case QNetworkReply::ProtocolInvalidOperationError:
+    case QNetworkReply::OperationNotImplementedError:
+        return ContentError;
+    default:
+        return OtherError;
+    }
+}
+
+RetryPolicy::ErrorClass RetryPolicy::classify(QAbstractSocket::SocketError error) {
+
+    switch (error) {
+    case QAbstractSocket::HostNotFoundError:
+        return HostError;
+    case QAbstractSocket::ConnectionRefusedError:
+        return RefusedError;
+    case QAbstractSocket::SslHandshakeFailedError:
+    case QAbstractSocket::SslInternalError:
+    case QAbstractSocket::SslInvalidUserDataError:
+        return TlsError;
+    case QAbstractSocket::RemoteHostClosedError:
+    case QAbstractSocket::SocketTimeoutError:
+    case QAbstractSocket::NetworkError:
+    case QAbstractSocket::TemporaryError:
+        return TransientError;
+    default:
+        return OtherError;
+    }
+}
+
+const char *RetryPolicy::className(ErrorClass errorClass) {
+
+    static const char * const names[] = {
+        "host", "refused", "tls", "transient", "server", "content", "other"
+    };
+    return names[errorClass];
+}
+
+RetryPolicy::Action RetryPolicy::action(ErrorClass errorClass, int tryCount) const {
+
+    switch (errorClass) {
+    case HostError:
+        return GiveUp; // http:// is the same host
+    case TransientError:
+        return (tryCount < m_maxRetries) ? Retry : FallBack;
+    case ServerError:
+        // the handshake worked, so http:// would not get us anything; for
+        // https:// the crawler does not get here, it has the certificate
+        return (tryCount < m_maxRetries) ? Retry : GiveUp;
+    case ContentError:
+        return GiveUp;
+    case RefusedError:
+    case TlsError:
+    case OtherError:
+        break;
+    }
+    return FallBack;
+}
+
+int RetryPolicy::retryDelay(int tryCount) {
+
+    qint64 delay = qint64(m_retryDelay) << qMin(tryCount, 16);
+    delay = qMin<qint64>(delay, s_maxRetryDelay);
+    // +-25%, so the retries of hosts that failed together do not come together
+    return int(delay * (0.75 + 0.5 * nextRandom()));
+}
+
+double RetryPolicy::nextRandom() {
+
+    // splitmix64: not for cryptography, but well distributed and
+    // independent of qrand(), whose sequence is the same in every thread
+    quint64 z = (m_randomState += Q_UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    z ^= z >> 31;
+    return (z >> 11) * (1.0 / (Q_UINT64_C(1) << 53));
+}
@@ -0,0 +1,76 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <QNetworkReply>
+#include <QAbstractSocket>
+
+// decides what to do after a request or probe failed, depending on what
+// kind of error it was: retrying does not help if the host does not exist,
+// and there is no point in trying http:// when the TLS handshake worked.
+// Retries are delayed exponentially, with some jitter; every policy has its
+// own random sequence, so crawlers in different threads and processes do
+// not retry in step.
+class RetryPolicy
+{
+public:
+    enum ErrorClass {
+        HostError,      // the host does not exist
+        RefusedError,   // nothing listening on the port
+        TlsError,       // the TLS handshake failed
+        TransientError, // timeouts, resets and other temporary failures
+        ServerError,    // the server answered with a 5xx status
+        ContentError,   // the server answered, but not with content (4xx etc.)
+        OtherError
+    };
+
+    enum Action {
+        GiveUp,
+        Retry,
+        FallBack // try http:// instead of https://
+    };
+
+    RetryPolicy(int maxRetries = 1, int retryDelay = 5000);
+
+    void setMaxRetries(int maxRetries) { m_maxRetries = maxRetries; }
+    // msecs before the first retry, doubled for every further one
+    void setRetryDelay(int msecs) { m_retryDelay = msecs; }
+
+    static ErrorClass classify(QNetworkReply::NetworkError error);
+    static ErrorClass classify(QAbstractSocket::SocketError error);
+    static const char *className(ErrorClass errorClass);
+
+    // tryCount is the number of retries done already
+    Action action(ErrorClass errorClass, int tryCount) const;
+    int retryDelay(int tryCount);
+
+private:
+    double nextRandom(); // in [0, 1)
+
+    int m_maxRetries;
+    int m_retryDelay;
+    quint64 m_randomState; // splitmix64
+    static const int s_maxRetryDelay;
+};
+
+#endif // RETRYPOLICY_H
@@ -0,0 +1,43 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef SEEDSOURCE_H
+#define SEEDSOURCE_H
+
+#include <QNetworkRequest>
+
+// where the frontier gets new requests from when it runs empty:
+// the top-1m.csv file (DomainSource) or the plan of a re-crawl (RecrawlPlanner).
+// Position and line are saved in checkpoints, their meaning depends on the source.
+class SeedSource
+{
+public:
+    virtual ~SeedSource() { }
+
+    virtual bool atEnd() const = 0;
+    // returns an empty request for seeds belonging to another shard
+    virtual QNetworkRequest nextRequest() = 0;
+    virtual int currentLine() const = 0;
+    virtual qint64 position() const = 0;
+    virtual void restorePosition(qint64 position, int line) = 0;
+};
+
+#endif // SEEDSOURCE_H
@@ -0,0 +1,49 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef SHARDING_H
+#define SHARDING_H
+
+#include <QHash>
+#include <QString>
+
+// all URLs of one host are handled by the same shard, so a shard owns
+// the visited / in-flight state of its hosts exclusively.
+// Uses jump consistent hashing (Lamping, Veach), so that changing the
+// number of shards only moves the hosts it has to.
+inline int shardForHost(const QString &host, int shardCount)
+{
+    if (shardCount <= 1)
+        return 0;
+    // fixed seed: stable across threads, processes and runs
+    quint64 key = qHash(host, 0);
+    key = (key ^ (key << 32)) * Q_UINT64_C(0x9e3779b97f4a7c15); // spread to 64 bits
+    qint64 bucket = -1;
+    qint64 next = 0;
+    while (next < shardCount) {
+        bucket = next;
+        key = key * Q_UINT64_C(2862933555777941757) + 1;
+        next = qint64((bucket + 1) * (double(Q_INT64_C(1) << 31) / double((key >> 33) + 1)));
+    }
+    return int(bucket);
+}
+
+#endif // SHARDING_H
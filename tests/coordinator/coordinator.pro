@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Smoke test of CrawlCoordinator with two worker
+# processes against the fake server farm in bench/
+#
+#-------------------------------------------------
+
+QT       += core network testlib
+
+QT       -= gui
+
+TARGET = tst_coordinator
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+include(../../crawler.pri)
+
+INCLUDEPATH += $$PWD/../../bench
+
+DEFINES += BENCH_SOURCE_DIR=\\\"$$PWD/../../bench\\\"
+
+SOURCES += tst_coordinator.cpp \
+    ../../bench/fakeserverfarm.cpp
+
+HEADERS += \
+    ../../bench/fakeserverfarm.h
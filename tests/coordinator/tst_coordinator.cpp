@@ -0,0 +1,277 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include <QtTest/QtTest>
+#include <QCommandLineParser>
+#include <QNetworkProxy>
+#include <QTemporaryDir>
+#include <QHostAddress>
+
+#include "crawlcoordinator.h"
+#include "crawlworker.h"
+#include "resultparser.h"
+#include "sharding.h"
+#include "fakeserverfarm.h"
+
+static const int s_siteCount = 40;
+static const int s_workerCount = 2;
+
+static QString workerResultFileName(int shard)
+{
+    return QStringLiteral("results.worker%1").arg(shard);
+}
+
+// in the worker process: writes "<url with certificate> <original URL>"
+// for every result of the worker, so the test knows who crawled what
+class WorkerResultLog : public QObject
+{
+    Q_OBJECT
+public:
+    WorkerResultLog(int shard, QObject *parent) :
+        QObject(parent),
+        m_file(workerResultFileName(shard))
+    {
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            qFatal("could not write %s", qPrintable(m_file.fileName()));
+    }
+
+public slots:
+    void results(const QList<CrawlResult> &results) {
+        foreach (const CrawlResult &result, results)
+            m_file.write(result.urlWithCertificate.toEncoded() + ' ' + result.originalUrl.toEncoded() + '\n');
+        m_file.flush();
+    }
+
+private:
+    QFile m_file;
+};
+
+// smoke test of a multi process crawl: a coordinator with two workers
+// (this executable started again with --coordinator) crawls the fake
+// server farm of the benchmark, which runs in the test process
+class tst_CrawlCoordinator : public QObject
+{
+    Q_OBJECT
+public:
+    tst_CrawlCoordinator();
+
+private slots:
+    void initTestCase();
+    void init();
+    void crawlWithTwoWorkers();
+    void workerFailsToStart();
+
+public slots:
+    void result(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                const QList<QSslCertificate> &certificateChain);
+
+private:
+    QStringList workerArguments() const;
+    bool wasCrawled(const QString &host) const { return m_crawlingShards.contains(host); }
+
+    QTemporaryDir m_workingDirectory;
+    FakeServerFarm *m_farm;
+    QVector<int> m_resultsByShard;
+    // by host, from the result logs of the workers
+    QHash<QString, int> m_crawlingShards;
+};
+
+tst_CrawlCoordinator::tst_CrawlCoordinator() :
+    m_farm(0)
+{
+}
+
+void tst_CrawlCoordinator::initTestCase() {
+
+    QVERIFY(m_workingDirectory.isValid());
+    QString certificateDirectory = m_workingDirectory.path() + QStringLiteral("/certificates");
+    QString script = QStringLiteral(BENCH_SOURCE_DIR "/generate-certificates.sh");
+    if (QProcess::execute(QStringLiteral("sh"), QStringList() << script << certificateDirectory << QStringLiteral("2")) != 0)
+        QSKIP("could not generate the certificates, is openssl installed?");
+
+    // the workers read top-1m.csv from the current directory
+    QFile file(m_workingDirectory.path() + QStringLiteral("/top-1m.csv"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QTextStream stream(&file);
+    for (int a = 1; a <= s_siteCount; a++)
+        stream << a << ",site" << a << ".bench\n";
+    stream.flush();
+    file.close();
+    QVERIFY(QDir::setCurrent(m_workingDirectory.path()));
+
+    FakeServerFarm::Config config;
+    config.siteCount = s_siteCount;
+    config.handshakeLatency = 0;
+    config.stallRatio = 0; // every host answers, so every site is crawled
+    config.deepLinkRatio = 0.5; // different URLs of a host, found by both workers
+    m_farm = new FakeServerFarm(config, this);
+    QVERIFY(m_farm->loadCertificates(certificateDirectory));
+    QVERIFY2(m_farm->listen(QHostAddress::LocalHost), qPrintable(m_farm->errorString()));
+}
+
+void tst_CrawlCoordinator::init() {
+
+    m_resultsByShard = QVector<int>(s_workerCount, 0);
+    m_crawlingShards.clear();
+}
+
+QStringList tst_CrawlCoordinator::workerArguments() const {
+
+    return QStringList() << QStringLiteral("--proxy-port") << QString::number(m_farm->serverPort())
+                         << QStringLiteral("--sites") << QString::number(s_siteCount);
+}
+
+void tst_CrawlCoordinator::result(const QUrl &originalUrl, const QUrl &urlWithCertificate,
+                                  const QList<QSslCertificate> &certificateChain) {
+
+    Q_UNUSED(originalUrl);
+    if (!certificateChain.isEmpty())
+        m_resultsByShard[shardForHost(urlWithCertificate.host(), s_workerCount)]++;
+}
+
+void tst_CrawlCoordinator::crawlWithTwoWorkers() {
+
+    QString outputFileName = m_workingDirectory.path() + QStringLiteral("/results.csv");
+    {
+        CrawlCoordinator coordinator(s_workerCount, workerArguments());
+        connect(&coordinator, SIGNAL(crawlResult(QUrl,QUrl,QList<QSslCertificate>)),
+                this, SLOT(result(QUrl,QUrl,QList<QSslCertificate>)));
+        ResultParser *parser = new ResultParser(&coordinator, outputFileName);
+        QSignalSpy parsedSpy(parser, SIGNAL(parsingDone()));
+        coordinator.start();
+        QVERIFY(parsedSpy.wait(120000));
+    } // waits for the workers to write their logs and exit
+    QVERIFY(m_resultsByShard.at(0) > 0);
+    QVERIFY(m_resultsByShard.at(1) > 0);
+
+    // every host is crawled by its owner only, and both got URLs found
+    // on the pages of the other one
+    QVector<int> routedResults(s_workerCount, 0);
+    for (int shard = 0; shard < s_workerCount; shard++) {
+        QFile file(workerResultFileName(shard));
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        foreach (const QByteArray &line, file.readAll().split('\n')) {
+            if (line.isEmpty())
+                continue;
+            QList<QByteArray> fields = line.split(' ');
+            QCOMPARE(fields.count(), 2);
+            QString host = QUrl::fromEncoded(fields.at(0)).host();
+            QCOMPARE(shardForHost(host, s_workerCount), shard);
+            QVERIFY2(m_crawlingShards.value(host, shard) == shard, qPrintable(host));
+            m_crawlingShards.insert(host, shard);
+            if (shardForHost(QUrl::fromEncoded(fields.at(1)).host(), s_workerCount) != shard)
+                routedResults[shard]++;
+        }
+    }
+    QVERIFY(routedResults.at(0) > 0);
+    QVERIFY(routedResults.at(1) > 0);
+
+    // the sites of top-1m.csv as the farm serves them
+    for (int a = 1; a <= s_siteCount; a++) {
+        QString host = QStringLiteral("www.site%1.bench").arg(a);
+        switch (m_farm->behavior(host)) {
+        case FakeServerFarm::NormalHost:
+            QVERIFY2(wasCrawled(host), qPrintable(host));
+            break;
+        case FakeServerFarm::RedirectingHost:
+            QVERIFY2(wasCrawled(QStringLiteral("secure.site%1.bench").arg(a)), qPrintable(host));
+            break;
+        case FakeServerFarm::UnknownHost:
+        case FakeServerFarm::StallingHost:
+            QVERIFY2(!wasCrawled(host), qPrintable(host));
+            break;
+        }
+    }
+
+    // one line per site, merging the linking URLs from both workers
+    QFile output(outputFileName);
+    QVERIFY(output.open(QIODevice::ReadOnly));
+    output.readLine(); // the header
+    QSet<QString> sites;
+    int mergedSites = 0;
+    while (!output.atEnd()) {
+        QStringList fields = QString::fromUtf8(output.readLine()).trimmed().split(QLatin1Char(';'));
+        QVERIFY(fields.count() >= 4);
+        QVERIFY2(!sites.contains(fields.at(0)), qPrintable(fields.at(0)));
+        sites.insert(fields.at(0));
+        QSet<int> linkingShards;
+        for (int a = 4; a < fields.count(); a++)
+            linkingShards.insert(shardForHost(QUrl(fields.at(a)).host(), s_workerCount));
+        if (linkingShards.count() == s_workerCount)
+            mergedSites++;
+    }
+    QVERIFY(mergedSites > 0);
+}
+
+void tst_CrawlCoordinator::workerFailsToStart() {
+
+    CrawlCoordinator coordinator(s_workerCount, workerArguments());
+    coordinator.setWorkerProgram(m_workingDirectory.path() + QStringLiteral("/no-such-worker"));
+    connect(&coordinator, SIGNAL(crawlResult(QUrl,QUrl,QList<QSslCertificate>)),
+            this, SLOT(result(QUrl,QUrl,QList<QSslCertificate>)));
+    QSignalSpy finishedSpy(&coordinator, SIGNAL(crawlFinished()));
+    coordinator.start();
+    // the coordinator must not wait for the workers forever
+    QVERIFY(finishedSpy.count() == 1 || finishedSpy.wait(10000));
+    QCOMPARE(m_resultsByShard.at(0) + m_resultsByShard.at(1), 0);
+}
+
+// what main.cpp does for a worker, with the fake server farm as proxy
+static int runWorker(QCoreApplication &app)
+{
+    QCommandLineParser commandLineParser;
+    QCommandLineOption proxyPortOption(QStringLiteral("proxy-port"), QString(), QStringLiteral("port"));
+    commandLineParser.addOption(proxyPortOption);
+    QCommandLineOption sitesOption(QStringLiteral("sites"), QString(), QStringLiteral("n"));
+    commandLineParser.addOption(sitesOption);
+    QCommandLineOption coordinatorOption(QStringLiteral("coordinator"), QString(), QStringLiteral("name"));
+    commandLineParser.addOption(coordinatorOption);
+    QCommandLineOption workerShardOption(QStringLiteral("worker-shard"), QString(), QStringLiteral("i"));
+    commandLineParser.addOption(workerShardOption);
+    QCommandLineOption workerShardsOption(QStringLiteral("worker-shards"), QString(), QStringLiteral("n"));
+    commandLineParser.addOption(workerShardsOption);
+    commandLineParser.process(app);
+
+    QNetworkProxy::setApplicationProxy(QNetworkProxy(QNetworkProxy::HttpProxy, QStringLiteral("127.0.0.1"),
+                                                     commandLineParser.value(proxyPortOption).toUShort()));
+    int shard = commandLineParser.value(workerShardOption).toInt();
+    QtSslCrawler *crawler = new QtSslCrawler(&app, 1, commandLineParser.value(sitesOption).toInt());
+    crawler->setHostResolution(0, 0); // the proxy resolves (or not)
+    crawler->setTimeouts(2000, 2000, 10000);
+    crawler->setShard(shard, commandLineParser.value(workerShardsOption).toInt());
+    WorkerResultLog *resultLog = new WorkerResultLog(shard, &app);
+    QObject::connect(crawler, SIGNAL(crawlResults(QList<CrawlResult>)),
+                     resultLog, SLOT(results(QList<CrawlResult>)));
+    CrawlWorker *worker = new CrawlWorker(crawler, shard, &app);
+    worker->start(commandLineParser.value(coordinatorOption));
+    return app.exec();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    if (app.arguments().contains(QStringLiteral("--coordinator")))
+        return runWorker(app);
+    tst_CrawlCoordinator test;
+    return QTest::qExec(&test, argc, argv);
+}
+
+#include "tst_coordinator.moc"
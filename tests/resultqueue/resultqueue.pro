@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Stress test of the lock-free ResultQueue with
+# several producer threads
+#
+#-------------------------------------------------
+
+QT       += core network testlib
+
+QT       -= gui
+
+TARGET = tst_resultqueue
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += $$PWD/../..
+
+SOURCES += tst_resultqueue.cpp \
+    ../../resultqueue.cpp
+
+HEADERS += \
+    ../../resultqueue.h
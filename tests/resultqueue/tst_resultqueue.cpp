@@ -0,0 +1,193 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include <QtTest/QtTest>
+
+#include "resultqueue.h"
+
+static ResultRecord record(int producer, int number)
+{
+    ResultRecord record;
+    record.originalUrl = QUrl(QStringLiteral("https://producer%1.test/%2").arg(producer).arg(number));
+    return record;
+}
+
+static int producerOf(const ResultRecord &record)
+{
+    return record.originalUrl.host().mid(8).section(QLatin1Char('.'), 0, 0).toInt();
+}
+
+static int numberOf(const ResultRecord &record)
+{
+    return record.originalUrl.path().mid(1).toInt();
+}
+
+// pushes count records numbered from 0 with the blocking push()
+class Producer : public QThread
+{
+public:
+    Producer(ResultQueue *queue, int index, int count) :
+        m_queue(queue), m_index(index), m_count(count) { }
+
+protected:
+    void run() {
+        for (int a = 0; a < m_count; a++)
+            m_queue->push(record(m_index, a));
+    }
+
+private:
+    ResultQueue *m_queue;
+    int m_index;
+    int m_count;
+};
+
+class tst_ResultQueue : public QObject
+{
+    Q_OBJECT
+private slots:
+    void capacity();
+    void emptyAndFull();
+    void wrapAround();
+    void pushBlocksWhileFull();
+    void multipleProducers_data();
+    void multipleProducers();
+};
+
+void tst_ResultQueue::capacity() {
+
+    QCOMPARE(ResultQueue(1).capacity(), 2);
+    QCOMPARE(ResultQueue(5).capacity(), 8);
+    QCOMPARE(ResultQueue(16).capacity(), 16);
+}
+
+void tst_ResultQueue::emptyAndFull() {
+
+    ResultQueue queue(4);
+    ResultRecord popped;
+    QVERIFY(!queue.tryPop(&popped));
+
+    for (int a = 0; a < 4; a++)
+        QVERIFY(queue.tryPush(record(0, a)));
+    QVERIFY(!queue.tryPush(record(0, 4)));
+
+    // one free slot takes exactly one more
+    QVERIFY(queue.tryPop(&popped));
+    QCOMPARE(numberOf(popped), 0);
+    QVERIFY(queue.tryPush(record(0, 4)));
+    QVERIFY(!queue.tryPush(record(0, 5)));
+
+    for (int a = 1; a <= 4; a++) {
+        QVERIFY(queue.tryPop(&popped));
+        QCOMPARE(numberOf(popped), a);
+    }
+    QVERIFY(!queue.tryPop(&popped));
+}
+
+void tst_ResultQueue::wrapAround() {
+
+    // every slot is reused many times, at every fill level
+    ResultQueue queue(4);
+    ResultRecord popped;
+    int pushed = 0;
+    int expected = 0;
+    for (int round = 0; round < 1000; round++) {
+        int fill = round % 5;
+        for (int a = 0; a < fill; a++)
+            QVERIFY(queue.tryPush(record(0, pushed++)));
+        for (int a = 0; a < fill; a++) {
+            QVERIFY(queue.tryPop(&popped));
+            QCOMPARE(numberOf(popped), expected++);
+        }
+        QVERIFY(!queue.tryPop(&popped));
+    }
+}
+
+void tst_ResultQueue::pushBlocksWhileFull() {
+
+    ResultQueue queue(2);
+    QVERIFY(queue.tryPush(record(0, 0)));
+    QVERIFY(queue.tryPush(record(0, 1)));
+
+    Producer producer(&queue, 0, 1);
+    producer.start();
+    QVERIFY(!producer.wait(100));
+
+    ResultRecord popped;
+    QVERIFY(queue.tryPop(&popped));
+    queue.wakeProducers();
+    QVERIFY(producer.wait(5000));
+    QVERIFY(queue.tryPop(&popped));
+    QCOMPARE(numberOf(popped), 1);
+    QVERIFY(queue.tryPop(&popped));
+    QCOMPARE(numberOf(popped), 0); // the record pushed by the producer
+    QVERIFY(!queue.tryPop(&popped));
+}
+
+void tst_ResultQueue::multipleProducers_data() {
+
+    QTest::addColumn<int>("capacity");
+    QTest::addColumn<int>("producerCount");
+    QTest::newRow("small queue") << 8 << 4;
+    QTest::newRow("large queue") << 1024 << 8;
+}
+
+void tst_ResultQueue::multipleProducers() {
+
+    QFETCH(int, capacity);
+    QFETCH(int, producerCount);
+    const int perProducer = 20000;
+
+    ResultQueue queue(capacity);
+    QList<Producer *> producers;
+    for (int a = 0; a < producerCount; a++)
+        producers.append(new Producer(&queue, a, perProducer));
+    foreach (Producer *producer, producers)
+        producer->start();
+
+    // every producer's records arrive once and in its order
+    QVector<int> nextNumber(producerCount, 0);
+    ResultRecord popped;
+    int received = 0;
+    while (received < producerCount * perProducer) {
+        int count = 0;
+        while (queue.tryPop(&popped)) {
+            int producer = producerOf(popped);
+            QVERIFY(producer >= 0 && producer < producerCount);
+            QCOMPARE(numberOf(popped), nextNumber.at(producer));
+            nextNumber[producer]++;
+            count++;
+        }
+        if (count > 0)
+            queue.wakeProducers();
+        else
+            QThread::yieldCurrentThread();
+        received += count;
+    }
+    QVERIFY(!queue.tryPop(&popped));
+
+    foreach (Producer *producer, producers)
+        QVERIFY(producer->wait(5000));
+    qDeleteAll(producers);
+}
+
+QTEST_GUILESS_MAIN(tst_ResultQueue)
+
+#include "tst_resultqueue.moc"
@@ -0,0 +1,12 @@
+#-------------------------------------------------
+#
+# Tests of the crawler, build and run with
+# "make tests" in the top level build directory
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    resultqueue \
+    coordinator
@@ -0,0 +1,122 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "urlextractor.h"
+
+#include <string.h>
+
+// longer "hosts" are cut off, so we do not carry over arbitrary amounts of data
+const int UrlExtractor::s_maxHostLength = 1024;
+
+// characters of [a-z0-9.@:], case insensitive
+class HostCharacterTable
+{
+public:
+    HostCharacterTable() {
+        for (int a = 0; a < 256; a++)
+            m_table[a] = (a >= 'a' && a <= 'z') || (a >= 'A' && a <= 'Z') || (a >= '0' && a <= '9')
+                    || a == '.' || a == '@' || a == ':';
+    }
+    bool contains(unsigned char c) const { return m_table[c]; }
+private:
+    bool m_table[256];
+};
+
+static const HostCharacterTable hostCharacters;
+
+static bool isHttpsPrefix(const char *data)
+{
+    // "https", case insensitive: setting bit 0x20 lower-cases ASCII letters
+    return (data[0] | 0x20) == 'h' && (data[1] | 0x20) == 't' && (data[2] | 0x20) == 't'
+            && (data[3] | 0x20) == 'p' && (data[4] | 0x20) == 's';
+}
+
+UrlExtractor::UrlExtractor() :
+    m_bytesScanned(0)
+{
+}
+
+void UrlExtractor::feed(const QByteArray &chunk) {
+
+    m_bytesScanned += chunk.size();
+    if (m_carryOver.isEmpty()) {
+        scan(chunk.constData(), chunk.size(), false);
+    } else {
+        QByteArray data = m_carryOver + chunk;
+        scan(data.constData(), data.size(), false);
+    }
+}
+
+void UrlExtractor::finish() {
+
+    QByteArray data = m_carryOver;
+    m_carryOver.clear();
+    scan(data.constData(), data.size(), true);
+}
+
+QList<QByteArray> UrlExtractor::takeUrls() {
+
+    QList<QByteArray> urls = m_urls;
+    m_urls.clear();
+    return urls;
+}
+
+void UrlExtractor::scan(const char *data, int size, bool atEnd) {
+
+    m_carryOver.clear();
+    int position = 0;
+    // ':' is rare in HTML compared to 'h', so look for that first
+    // (memchr is vectorized) and check "https" and "//" around it
+    while (const char *colon = static_cast<const char *>(memchr(data + position, ':', size - position))) {
+        int colonPosition = colon - data;
+        if (colonPosition < 5 || !isHttpsPrefix(colon - 5)) {
+            position = colonPosition + 1;
+            continue;
+        }
+        if (colonPosition + 2 >= size) {
+            if (!atEnd)
+                m_carryOver = QByteArray(colon - 5, size - colonPosition + 5);
+            return;
+        }
+        if (colon[1] != '/' || colon[2] != '/') {
+            position = colonPosition + 1;
+            continue;
+        }
+        int hostStart = colonPosition + 3;
+        int hostEnd = hostStart;
+        while (hostEnd < size && hostEnd - hostStart < s_maxHostLength
+               && hostCharacters.contains(static_cast<unsigned char>(data[hostEnd])))
+            hostEnd++;
+        if (hostEnd == size && !atEnd && hostEnd - hostStart < s_maxHostLength) {
+            // the host might continue in the next chunk
+            m_carryOver = QByteArray(colon - 5, size - colonPosition + 5);
+            return;
+        }
+        if (hostEnd > hostStart)
+            m_urls.append(QByteArray("https://") + QByteArray(data + hostStart, hostEnd - hostStart));
+        position = hostEnd;
+    }
+    // the end of this chunk might be the start of "https:"
+    if (!atEnd) {
+        int carryOverStart = qMax(position, size - 5);
+        m_carryOver = QByteArray(data + carryOverStart, size - carryOverStart);
+    }
+}
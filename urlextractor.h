@@ -0,0 +1,52 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef URLEXTRACTOR_H
+#define URLEXTRACTOR_H
+
+#include <QByteArray>
+#include <QList>
+
+// finds "https://host" URLs in a body that arrives in chunks; matches
+// the same as the regexp "(https://[a-z0-9.@:]+)" (case insensitive).
+// Only the few bytes that might belong to a match spanning two chunks
+// are kept between calls to feed().
+class UrlExtractor
+{
+public:
+    UrlExtractor();
+
+    void feed(const QByteArray &chunk);
+    // call after the last chunk, a URL might end with the body
+    void finish();
+    QList<QByteArray> takeUrls();
+    qint64 bytesScanned() const { return m_bytesScanned; }
+
+private:
+    void scan(const char *data, int size, bool atEnd);
+
+    QByteArray m_carryOver;
+    QList<QByteArray> m_urls;
+    qint64 m_bytesScanned;
+    static const int s_maxHostLength;
+};
+
+#endif // URLEXTRACTOR_H
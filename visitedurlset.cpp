@@ -0,0 +1,230 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "visitedurlset.h"
+
+#include <math.h>
+
+static const int initialFingerprintSlots = 1024;
+// rough size of a QUrl with its private data plus the QSet node,
+// only used to estimate the memory usage in ExactMode
+static const int estimatedUrlSize = 200;
+
+static quint64 mix(quint64 hash)
+{
+    // finalizer of splitmix64
+    hash ^= hash >> 30;
+    hash *= Q_UINT64_C(0xbf58476d1ce4e5b9);
+    hash ^= hash >> 27;
+    hash *= Q_UINT64_C(0x94d049bb133111eb);
+    hash ^= hash >> 31;
+    return hash;
+}
+
+VisitedUrlSet::VisitedUrlSet(Mode mode) :
+    m_mode(ExactMode),
+    m_count(0),
+    m_bloomBitCount(0),
+    m_bloomHashCount(0)
+{
+    setMode(mode);
+}
+
+void VisitedUrlSet::setMode(Mode mode) {
+
+    m_mode = mode;
+    m_count = 0;
+    m_urls.clear();
+    m_fingerprints.clear();
+    m_bloomBits.clear();
+    if (mode == FingerprintMode)
+        m_fingerprints.fill(0, initialFingerprintSlots);
+    else if (mode == BloomFilterMode)
+        setBloomFilterSize(10000000, 0.001);
+}
+
+void VisitedUrlSet::setBloomFilterSize(qint64 expectedCount, double falsePositiveRate) {
+
+    falsePositiveRate = qBound(1e-9, falsePositiveRate, 0.5);
+    expectedCount = qMax<qint64>(1, expectedCount);
+    // m = -n ln(p) / ln(2)^2 bits and k = m / n ln(2) hash functions
+    double bits = -double(expectedCount) * log(falsePositiveRate) / (log(2.0) * log(2.0));
+    m_bloomBitCount = qMax<quint64>(64, quint64(bits));
+    m_bloomHashCount = qMax(1, int(bits / expectedCount * log(2.0) + 0.5));
+    m_bloomBits.fill(0, (m_bloomBitCount + 63) / 64);
+    m_count = 0;
+}
+
+quint64 VisitedUrlSet::fingerprint(const QUrl &url) {
+
+    QByteArray encoded = url.toEncoded();
+    quint64 hash = Q_UINT64_C(14695981039346656037); // FNV-1a
+    for (int a = 0; a < encoded.size(); a++) {
+        hash ^= static_cast<uchar>(encoded.at(a));
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    hash = mix(hash);
+    return hash ? hash : 1; // 0 marks empty slots
+}
+
+bool VisitedUrlSet::contains(const QUrl &url) const {
+
+    switch (m_mode) {
+    case ExactMode:
+        return m_urls.contains(url);
+    case FingerprintMode:
+        return containsFingerprint(fingerprint(url));
+    case BloomFilterMode:
+        return bloomFilterContains(fingerprint(url));
+    }
+    return false;
+}
+
+void VisitedUrlSet::insert(const QUrl &url) {
+
+    switch (m_mode) {
+    case ExactMode:
+        m_urls.insert(url);
+        m_count = m_urls.count();
+        break;
+    case FingerprintMode:
+        insertFingerprint(fingerprint(url));
+        break;
+    case BloomFilterMode: {
+        quint64 urlFingerprint = fingerprint(url);
+        if (bloomFilterContains(urlFingerprint))
+            break;
+        // double hashing, see Kirsch and Mitzenmacher
+        quint64 second = mix(urlFingerprint) | 1;
+        for (int a = 0; a < m_bloomHashCount; a++) {
+            quint64 bit = (urlFingerprint + a * second) % m_bloomBitCount;
+            m_bloomBits[bit / 64] |= Q_UINT64_C(1) << (bit % 64);
+        }
+        m_count++;
+        break;
+    }
+    }
+}
+
+qint64 VisitedUrlSet::memoryUsage() const {
+
+    switch (m_mode) {
+    case ExactMode:
+        return m_count * estimatedUrlSize;
+    case FingerprintMode:
+        return m_fingerprints.size() * sizeof(quint64);
+    case BloomFilterMode:
+        return m_bloomBits.size() * sizeof(quint64);
+    }
+    return 0;
+}
+
+bool VisitedUrlSet::bloomFilterContains(quint64 fingerprint) const {
+
+    quint64 second = mix(fingerprint) | 1;
+    for (int a = 0; a < m_bloomHashCount; a++) {
+        quint64 bit = (fingerprint + a * second) % m_bloomBitCount;
+        if (!(m_bloomBits.at(bit / 64) & (Q_UINT64_C(1) << (bit % 64))))
+            return false;
+    }
+    return true;
+}
+
+bool VisitedUrlSet::containsFingerprint(quint64 fingerprint) const {
+
+    int mask = m_fingerprints.size() - 1;
+    for (int slot = fingerprint & mask; m_fingerprints.at(slot) != 0; slot = (slot + 1) & mask) {
+        if (m_fingerprints.at(slot) == fingerprint)
+            return true;
+    }
+    return false;
+}
+
+void VisitedUrlSet::insertFingerprint(quint64 fingerprint) {
+
+    if ((m_count + 1) * 5 > qint64(m_fingerprints.size()) * 4) // load factor 0.8
+        growFingerprints();
+    int mask = m_fingerprints.size() - 1;
+    int slot = fingerprint & mask;
+    for (; m_fingerprints.at(slot) != 0; slot = (slot + 1) & mask) {
+        if (m_fingerprints.at(slot) == fingerprint)
+            return;
+    }
+    m_fingerprints[slot] = fingerprint;
+    m_count++;
+}
+
+void VisitedUrlSet::growFingerprints() {
+
+    QVector<quint64> oldFingerprints = m_fingerprints;
+    m_fingerprints.fill(0, oldFingerprints.size() * 2);
+    m_count = 0;
+    foreach (quint64 fingerprint, oldFingerprints) {
+        if (fingerprint != 0)
+            insertFingerprint(fingerprint);
+    }
+}
+
+QDataStream &operator<<(QDataStream &stream, const VisitedUrlSet &set)
+{
+    stream << qint32(set.m_mode) << set.m_count;
+    switch (set.m_mode) {
+    case VisitedUrlSet::ExactMode:
+        foreach (const QUrl &url, set.m_urls)
+            stream << url.toEncoded();
+        break;
+    case VisitedUrlSet::FingerprintMode:
+        stream << set.m_fingerprints;
+        break;
+    case VisitedUrlSet::BloomFilterMode:
+        stream << set.m_bloomBitCount << qint32(set.m_bloomHashCount) << set.m_bloomBits;
+        break;
+    }
+    return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, VisitedUrlSet &set)
+{
+    qint32 mode;
+    qint64 count;
+    stream >> mode >> count;
+    set.setMode(static_cast<VisitedUrlSet::Mode>(mode));
+    switch (set.m_mode) {
+    case VisitedUrlSet::ExactMode:
+        for (qint64 a = 0; a < count && stream.status() == QDataStream::Ok; a++) {
+            QByteArray url;
+            stream >> url;
+            set.m_urls.insert(QUrl::fromEncoded(url));
+        }
+        break;
+    case VisitedUrlSet::FingerprintMode:
+        stream >> set.m_fingerprints;
+        break;
+    case VisitedUrlSet::BloomFilterMode: {
+        qint32 hashCount;
+        stream >> set.m_bloomBitCount >> hashCount >> set.m_bloomBits;
+        set.m_bloomHashCount = hashCount;
+        break;
+    }
+    }
+    set.m_count = count;
+    return stream;
+}
@@ -0,0 +1,86 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef VISITEDURLSET_H
+#define VISITEDURLSET_H
+
+#include <QDataStream>
+#include <QSet>
+#include <QUrl>
+#include <QVector>
+
+// the set of URLs the crawler is done with; it only grows during a crawl
+// and is the biggest memory consumer on link-heavy crawls, so apart from
+// storing the URLs there are two compact modes:
+//  - fingerprints: 64-bit hashes of the URLs in an
+//    open-addressing table (about 10-20 bytes per URL, collisions are
+//    practically impossible for the number of URLs we see)
+//  - Bloom filter: sized for an expected number of URLs and a false
+//    positive rate; a false positive means a new URL is skipped
+// All modes get the same URLs (CrawlFrontier normalizes them first), so
+// which URLs are crawled does not depend on the mode.
+class VisitedUrlSet
+{
+public:
+    enum Mode {
+        ExactMode,
+        FingerprintMode,
+        BloomFilterMode
+    };
+
+    explicit VisitedUrlSet(Mode mode = ExactMode);
+
+    void setMode(Mode mode);
+    // only for BloomFilterMode, clears the set
+    void setBloomFilterSize(qint64 expectedCount, double falsePositiveRate);
+    Mode mode() const { return m_mode; }
+
+    bool contains(const QUrl &url) const;
+    void insert(const QUrl &url);
+    qint64 count() const { return m_count; }
+    // in ExactMode only an estimate, see memoryUsageIsEstimate()
+    qint64 memoryUsage() const;
+    bool memoryUsageIsEstimate() const { return m_mode == ExactMode; }
+
+    static quint64 fingerprint(const QUrl &url);
+
+    friend QDataStream &operator<<(QDataStream &stream, const VisitedUrlSet &set);
+    friend QDataStream &operator>>(QDataStream &stream, VisitedUrlSet &set);
+
+private:
+    bool containsFingerprint(quint64 fingerprint) const;
+    void insertFingerprint(quint64 fingerprint);
+    void growFingerprints();
+    bool bloomFilterContains(quint64 fingerprint) const;
+
+    Mode m_mode;
+    qint64 m_count;
+    // ExactMode
+    QSet<QUrl> m_urls;
+    // FingerprintMode, 0 marks an empty slot, the size is a power of two
+    QVector<quint64> m_fingerprints;
+    // BloomFilterMode
+    QVector<quint64> m_bloomBits;
+    quint64 m_bloomBitCount;
+    int m_bloomHashCount;
+};
+
+#endif // VISITEDURLSET_H
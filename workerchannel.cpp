@@ -0,0 +1,170 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#include "workerchannel.h"
+#include "logging.h"
+
+#include <QLocalSocket>
+#include <QDataStream>
+#include <QSslCertificate>
+#include <QtEndian>
+
+WorkerChannel::WorkerChannel(QLocalSocket *socket, QObject *parent) :
+    QObject(parent),
+    m_socket(socket)
+{
+    m_socket->setParent(this);
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(readMessages()));
+    connect(m_socket, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+}
+
+void WorkerChannel::sendHello(int shardIndex) {
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(HelloMessage) << qint32(shardIndex);
+    sendMessage(message);
+}
+
+void WorkerChannel::sendResults(const QList<CrawlResult> &results) {
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(ResultsMessage) << qint32(results.count());
+    foreach (const CrawlResult &result, results) {
+        stream << result.originalUrl << result.urlWithCertificate
+               << qint32(result.certificateChain.count());
+        foreach (const QSslCertificate &certificate, result.certificateChain)
+            stream << certificate.toDer();
+    }
+    sendMessage(message);
+}
+
+void WorkerChannel::sendIdle(int routedUrlsReceived) {
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(IdleMessage) << qint32(routedUrlsReceived);
+    sendMessage(message);
+}
+
+void WorkerChannel::sendUrls(const QList<FoundUrl> &urls) {
+
+    QByteArray message;
+    QDataStream stream(&message, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << quint8(UrlsMessage) << qint32(urls.count());
+    foreach (const FoundUrl &url, urls)
+        stream << url.url << url.originalUrl;
+    sendMessage(message);
+}
+
+void WorkerChannel::sendQuit() {
+
+    QByteArray message;
+    message.append(char(QuitMessage));
+    sendMessage(message);
+    m_socket->flush();
+}
+
+void WorkerChannel::sendMessage(const QByteArray &message) {
+
+    uchar length[4];
+    qToBigEndian<quint32>(message.size(), length);
+    m_socket->write(reinterpret_cast<const char *>(length), 4);
+    m_socket->write(message);
+}
+
+void WorkerChannel::readMessages() {
+
+    m_buffer.append(m_socket->readAll());
+    int offset = 0;
+    while (m_buffer.size() - offset >= 4) {
+        quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(m_buffer.constData() + offset));
+        if (quint32(m_buffer.size() - offset - 4) < length)
+            break; // wait for the rest of the message
+        handleMessage(m_buffer.mid(offset + 4, length));
+        offset += 4 + length;
+    }
+    m_buffer.remove(0, offset);
+}
+
+void WorkerChannel::handleMessage(const QByteArray &message) {
+
+    QDataStream stream(message);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint8 type;
+    stream >> type;
+    switch (type) {
+    case HelloMessage: {
+        qint32 shardIndex;
+        stream >> shardIndex;
+        emit helloReceived(shardIndex);
+        break;
+    }
+    case ResultsMessage: {
+        qint32 count;
+        stream >> count;
+        QList<CrawlResult> results;
+        for (int a = 0; a < count && stream.status() == QDataStream::Ok; a++) {
+            CrawlResult result;
+            qint32 chainLength;
+            stream >> result.originalUrl >> result.urlWithCertificate >> chainLength;
+            for (int b = 0; b < chainLength && stream.status() == QDataStream::Ok; b++) {
+                QByteArray der;
+                stream >> der;
+                result.certificateChain.append(QSslCertificate(der, QSsl::Der));
+            }
+            results.append(result);
+        }
+        emit resultsReceived(results);
+        break;
+    }
+    case IdleMessage: {
+        qint32 routedUrlsReceived;
+        stream >> routedUrlsReceived;
+        emit idleReceived(routedUrlsReceived);
+        break;
+    }
+    case UrlsMessage: {
+        qint32 count;
+        stream >> count;
+        QList<FoundUrl> urls;
+        for (int a = 0; a < count && stream.status() == QDataStream::Ok; a++) {
+            FoundUrl url;
+            stream >> url.url >> url.originalUrl;
+            urls.append(url);
+        }
+        emit urlsReceived(urls);
+        break;
+    }
+    case QuitMessage:
+        emit quitReceived();
+        break;
+    default:
+        qCWarning(lcShards, "event=unknown_message type=%d", int(type));
+    }
+    if (stream.status() != QDataStream::Ok)
+        qCWarning(lcShards, "event=unreadable_message type=%d", int(type));
+}
@@ -0,0 +1,82 @@
+/*************************************************************************************
+**
+** QtSslCrawl
+** Copyright (C) 2012 Peter Hartmann <9qgm-76ea@xemaps.com>
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License as published by the Free Software Foundation; either
+** version 2.1 of the License, or (at your option) any later version.
+**
+** This library is distributed in the hope that it will be useful,
+** but WITHOUT ANY WARRANTY; without even the implied warranty of
+** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+** Lesser General Public License for more details.
+**
+** You should have received a copy of the GNU Lesser General Public
+** License along with this library; if not, write to the Free Software
+** Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+**
+*************************************************************************************/
+
+#ifndef WORKERCHANNEL_H
+#define WORKERCHANNEL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QUrl>
+
+#include "qt-ssl-crawler.h"
+
+class QLocalSocket;
+
+// the connection between the coordinator and one worker process.
+// Messages are framed with a 32 bit length and serialized with QDataStream;
+// certificates are sent in DER format.
+class WorkerChannel : public QObject
+{
+    Q_OBJECT
+public:
+    // takes ownership of the socket
+    explicit WorkerChannel(QLocalSocket *socket, QObject *parent = 0);
+
+    QLocalSocket *socket() const { return m_socket; }
+
+    // worker -> coordinator
+    void sendHello(int shardIndex);
+    void sendResults(const QList<CrawlResult> &results);
+    void sendIdle(int routedUrlsReceived);
+    // both directions
+    void sendUrls(const QList<FoundUrl> &urls);
+    // coordinator -> worker
+    void sendQuit();
+
+signals:
+    void helloReceived(int shardIndex);
+    void resultsReceived(const QList<CrawlResult> &results);
+    void idleReceived(int routedUrlsReceived);
+    void urlsReceived(const QList<FoundUrl> &urls);
+    void quitReceived();
+    void disconnected();
+
+private slots:
+    void readMessages();
+
+private:
+    enum MessageType {
+        HelloMessage = 'H',
+        ResultsMessage = 'R',
+        IdleMessage = 'I',
+        UrlsMessage = 'U',
+        QuitMessage = 'Q'
+    };
+
+    void sendMessage(const QByteArray &message);
+    void handleMessage(const QByteArray &message);
+
+    QLocalSocket *m_socket;
+    QByteArray m_buffer;
+};
+
+#endif // WORKERCHANNEL_H